@@ -3,18 +3,18 @@
 #include <transmitter.h>
 #include <receiver.h>
 
-void callback(std::vector<std::vector<unsigned char> > payloads);
-bool set_realtime_priority();
-
 using namespace std;
 using namespace fun;
 
+void callback(const std::vector<payload_buffer> & payloads);
+bool set_realtime_priority();
+
 int main()
 {
     set_realtime_priority();
 
     usrp_params params = usrp_params();
-    transmitter tx = transmitter(params);
+    transmitter tx(params);
     receiver rx = receiver(&callback, params);
 
     std::string s = "Hello World";
@@ -34,7 +34,7 @@ int main()
     return 0;
 }
 
-void callback(std::vector<std::vector<unsigned char> > payloads)
+void callback(const std::vector<payload_buffer> & payloads)
 {
     for(int i = 0; i < payloads.size(); i++)
     {
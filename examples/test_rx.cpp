@@ -15,7 +15,7 @@ using namespace fun;
 
 void test_rx(double freq, double sample_rate, double rx_gain);
 void test_rx_pause(double freq, double rate, double rx_gain);
-void process_packets_callback(std::vector<std::vector<unsigned char> > packets);
+void process_packets_callback(const std::vector<payload_buffer> & packets);
 bool set_realtime_priority();
 
 double freq = 5.72e9;
@@ -109,7 +109,7 @@ void test_rx_pause(double freq, double sample_rate, double rx_gain)
  *  This function merely counts the number of received packets and prints the timestamps
  *  of when the packets were received.
  */
-void process_packets_callback(std::vector<std::vector<unsigned char> > packets)
+void process_packets_callback(const std::vector<payload_buffer> & packets)
 {
     rx_count += packets.size();
 
@@ -84,7 +84,7 @@ void test_sim()
         if(end > samples_con.size()) end = samples_con.size();
         std::vector<std::complex<double> > chunk(&samples_con[start], &samples_con[end]);
 
-        std::vector<std::vector<unsigned char> > rec_frames = receiver->process_samples(chunk);
+        const std::vector<payload_buffer> & rec_frames = receiver->process_samples(chunk);
         count += rec_frames.size();
 
         if(rec_frames.size()){
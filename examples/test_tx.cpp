@@ -49,7 +49,7 @@ void test_tx(double freq, double sample_rate, double tx_gain, double amp, Rate p
 {
     srand(time(NULL)); //Initialize random seed
 
-    transmitter tx = transmitter(freq, sample_rate, tx_gain, amp);
+    transmitter tx(freq, sample_rate, tx_gain, amp);
     std::string known_string("This known string is used to verify the correctness of the received data along with the IEEE CRC-32!");
 
     int num_packets = 1000;
@@ -10,19 +10,20 @@
 #define BLOCK_H
 
 /*! \def BUFFER_MAX
- *  \brief Maximum buffer size of for the input & output buffers
+ *  \brief Maximum buffer size in samples for the input & output buffers
  *
  *  Techinically each block uses the
  * ~~~{.cpp}
  * std::vector::reserve(size_type n)
  * ~~~
- * function to reserve BUFFER_MAX * sizeof(size_type) bytes
+ * function to reserve room for BUFFER_MAX complex samples, i.e. BUFFER_MAX items for
+ * buffers of samples and proportionally fewer for buffers of whole symbols
  */
-
 #define BUFFER_MAX 65536
 
 #include <vector>
 #include <string>
+#include <complex>
 
 namespace fun
 {
@@ -73,14 +74,16 @@ namespace fun
         /*!
          * \brief constructor
          *
-         * Reserves BUFFER_MAX * sizeof(size_type) for the input and output buffers.
+         * Reserves BUFFER_MAX * sizeof(std::complex<double>) bytes for each of the input and
+         * output buffers. A buffer of 48 sample symbols thus reserves about a thousand symbols
+         * rather than BUFFER_MAX of them, which would be tens of megabytes per buffer.
          * \param block_name the name of the block as a std::string
          */
         block(std::string block_name) :
             block_base(block_name)
         {
-            input_buffer.reserve(BUFFER_MAX);
-            output_buffer.reserve(BUFFER_MAX);
+            input_buffer.reserve(buffer_items<I>());
+            output_buffer.reserve(buffer_items<O>());
         }
 
         /*!
@@ -98,7 +101,7 @@ namespace fun
          *
          * Contains new input items of type I. There is no guarantee on the number of items
          * passed to the input_buffer for each call to work except that it must be less than
-         * #BUFFER_MAX.
+         * #BUFFER_MAX samples worth of items.
          */
         std::vector<I> input_buffer;
 
@@ -106,9 +109,20 @@ namespace fun
          * \brief output_buffer is where the output items of the block should be placed
          *
          * There is no restriction on the number of output items a block must produce on each call
-         * except that it must be less than #BUFFER_MAX.
+         * except that it must be less than #BUFFER_MAX samples worth of items.
          */
         std::vector<O> output_buffer;
+
+    private:
+
+        /*!
+         * \brief Number of items of type T that take up as much memory as BUFFER_MAX samples.
+         */
+        template<typename T>
+        static size_t buffer_items()
+        {
+            return (BUFFER_MAX * sizeof(std::complex<double>) + sizeof(T) - 1) / sizeof(T);
+        }
     };
 
 }
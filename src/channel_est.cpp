@@ -6,16 +6,20 @@
  *  of the channel attenuation & phase rotation to each of the subcarriers.
  */
 
+#include <algorithm>
+#include <cfloat>
 #include <cstring>
 
 #include "channel_est.h"
 #include "preamble.h"
+#include "dsp_kernels.h"
 
 namespace fun
 {
     /*!
      * - Initializations:
      *   + #m_chan_est -> 64 complex doubles each initialized to (1+0j)
+     *   + #m_csi -> 1 for every subcarrier (no weighting until the first LTS)
      *   + #m_lts_flag -> 0 or in other words not in the LTS
      *   + #m_frame_start -> false
      */
@@ -25,6 +29,7 @@ namespace fun
         m_lts_flag(0),
         m_frame_start(false)
     {
+        for(int j = 0; j < 64; j++) m_csi[j] = 1;
     }
 
     /*!
@@ -56,17 +61,19 @@ namespace fun
                     std::complex<double> rec_lts_sample = input_buffer[i].samples[j];
                     m_chan_est[j] += ref_lts_sample / rec_lts_sample / 2.0;
                 }
+                if(m_lts_flag == 1) memcpy(m_lts1, input_buffer[i].samples, sizeof(m_lts1));
 
                 m_lts_flag++;
                 if(m_lts_flag == 3) // No more LTS symbols
                 {
                     m_lts_flag = 0;
                     m_frame_start = true; // Next symbol is the start of frame
+                    estimate_csi(input_buffer[i].samples);
                 }
             }
             else
             {
-                tagged_vector<64> symbol;
+                tagged_csi_vector<64> symbol;
                 if(m_frame_start)
                 {
                     symbol.tag = START_OF_FRAME;
@@ -74,16 +81,37 @@ namespace fun
                 }
 
                 // Apply channel correction
-                for(int j = 0; j < 64; j++)
-                {
-                    std::complex<double> out_sample = m_chan_est[j] * input_buffer[i].samples[j];
-                    symbol.samples[j] = out_sample;
-                }
+                dsp_kernels::equalize(input_buffer[i].samples, &m_chan_est[0], symbol.samples, 64);
+                memcpy(symbol.csi, m_csi, sizeof(m_csi));
                 output_buffer.push_back(symbol);
             }
         }
     }
 
-}
+    /*!
+     * Both LTS symbols carry the same samples, so their difference is only noise:
+     * E|lts1 - lts2|^2 = 2 * noise power. The channel gain of a subcarrier is the inverse
+     * of its correction, |H|^2 = 1 / |m_chan_est|^2.
+     */
+    void channel_est::estimate_csi(const std::complex<double> * lts2)
+    {
+        double noise = 0;
+        int active = 0;
+        for(int j = 0; j < 64; j++)
+        {
+            if(LTS_FREQ_DOMAIN[j] == std::complex<double>(0, 0)) continue;
+            noise += std::norm(m_lts1[j] - lts2[j]) / 2.0;
+            active++;
+        }
+        noise /= active;
 
+        for(int j = 0; j < 64; j++)
+        {
+            double correction = std::norm(m_chan_est[j]);
+            if(LTS_FREQ_DOMAIN[j] == std::complex<double>(0, 0) || correction == 0) m_csi[j] = 0;
+            else if(noise > 0) m_csi[j] = std::min(1.0 / (correction * noise), double(FLT_MAX));
+            else m_csi[j] = FLT_MAX;
+        }
+    }
 
+}
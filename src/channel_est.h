@@ -23,13 +23,15 @@ namespace fun
      *
      * Inputs tagged_vector<64> from the fft_symbols block.
      *
-     * Outputs tagged_vector<64> to the phase_tracker block.
+     * Outputs tagged_csi_vector<64> to the phase_tracker block.
      *
      * The Channel Estimate block is in charge of estimating the current channel conditions
      * using the two known LTS symbols and equalizing the channel affect by applying the inverse
-     * of the channel attenuation & phase rotation to each of the subcarriers.
+     * of the channel attenuation & phase rotation to each of the subcarriers. The difference
+     * between the two LTS symbols gives the noise power, so every output symbol also carries
+     * the SNR of each subcarrier for the soft demapper.
      */
-    class channel_est : public fun::block<tagged_vector<64>, tagged_vector<64> >
+    class channel_est : public fun::block<tagged_vector<64>, tagged_csi_vector<64> >
     {
     public:
 
@@ -43,6 +45,10 @@ namespace fun
 
         std::vector<std::complex<double> > m_chan_est; //!< Current channel estimate for each subcarrier.
 
+        std::complex<double> m_lts1[64]; //!< The first received LTS symbol, for the noise estimate.
+
+        float m_csi[64]; //!< SNR of each subcarrier, |H|^2 / noise power, 0 for the nulls.
+
         /*!
          * \brief Flag to indicate whether the current symbols are part of the LTS or not.
          *
@@ -58,6 +64,12 @@ namespace fun
          * or in other words the first symbol after the second LTS symbol.
          */
         bool m_frame_start;
+
+        /*!
+         * \brief Estimates the noise power and the SNR of each subcarrier from the two LTS symbols.
+         * \param lts2 The second received LTS symbol, the first one is in #m_lts1.
+         */
+        void estimate_csi(const std::complex<double> * lts2);
     };
 }
 
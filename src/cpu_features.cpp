@@ -0,0 +1,86 @@
+/*! \file cpu_features.cpp
+ *  \brief C++ file for the cpu_features class.
+ *
+ *  The cpu_features class detects the instruction set extensions supported by the
+ *  host CPU at startup and decides which implementation of each hot kernel should be used.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "cpu_features.h"
+
+namespace fun
+{
+    static const char * ARCH_NAMES[ARCH_COUNT] = { "generic", "sse2", "avx2", "avx512" };
+
+    // -1 until the first call to active()
+    static std::atomic<int> g_active_arch(-1);
+
+    /*!
+     * Uses cpuid (through the compiler builtins, which also verify that the OS saves the
+     * extended register state) to find the best supported level.
+     */
+    cpu_arch cpu_features::detected()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return ARCH_AVX512;
+        if(__builtin_cpu_supports("avx2")) return ARCH_AVX2;
+        if(__builtin_cpu_supports("sse2")) return ARCH_SSE2;
+    #endif
+        return ARCH_GENERIC;
+    }
+
+    /*!
+     * The first call picks the detected level or the one requested through FUN_OFDM_ARCH.
+     * A requested level that the CPU doesn't support is ignored with a warning.
+     */
+    cpu_arch cpu_features::active()
+    {
+        int arch = g_active_arch.load(std::memory_order_relaxed);
+        if(arch >= 0) return cpu_arch(arch);
+
+        arch = detected();
+        const char * env = getenv("FUN_OFDM_ARCH");
+        if(env != NULL)
+        {
+            int requested = -1;
+            for(int a = 0; a < ARCH_COUNT; a++) if(strcmp(env, ARCH_NAMES[a]) == 0) requested = a;
+
+            if(requested < 0 || requested > arch)
+                std::cerr << "FUN_OFDM_ARCH=" << env << " is not supported on this CPU, using " << ARCH_NAMES[arch] << std::endl;
+            else
+                arch = requested;
+        }
+
+        // Another thread may have raced us here, it came to the same conclusion
+        g_active_arch.store(arch, std::memory_order_relaxed);
+        return cpu_arch(arch);
+    }
+
+    bool cpu_features::force(cpu_arch arch)
+    {
+        if(arch < ARCH_GENERIC || arch >= ARCH_COUNT || arch > detected()) return false;
+        g_active_arch.store(arch, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool cpu_features::has_avx512_vbmi()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        static const bool vbmi = __builtin_cpu_supports("avx512vbmi");
+        return vbmi && active() == ARCH_AVX512;
+    #else
+        return false;
+    #endif
+    }
+
+    const char * cpu_features::name(cpu_arch arch)
+    {
+        if(arch < ARCH_GENERIC || arch >= ARCH_COUNT) return "unknown";
+        return ARCH_NAMES[arch];
+    }
+}
@@ -0,0 +1,96 @@
+/*! \file cpu_features.h
+ *  \brief Header file for the cpu_features class.
+ *
+ *  The cpu_features class detects the instruction set extensions supported by the
+ *  host CPU at startup (via cpuid) and decides which implementation of each hot
+ *  kernel (Viterbi, FFT, correlators, demapper, equalizer) should be used. The
+ *  selection can be overridden, either through the FUN_OFDM_ARCH environment variable
+ *  or programmatically with cpu_features::force(), which is useful when benchmarking
+ *  or bisecting a particular kernel variant.
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+namespace fun
+{
+    /*!
+     * \brief The instruction set levels that kernels can be specialized for.
+     *
+     * The levels are ordered, i.e. a CPU supporting #ARCH_AVX512 also supports
+     * every level below it.
+     */
+    enum cpu_arch : int
+    {
+        ARCH_GENERIC = 0, //!< Portable C++ only
+        ARCH_SSE2 = 1,    //!< SSE2 (baseline for x86-64)
+        ARCH_AVX2 = 2,    //!< AVX2
+        ARCH_AVX512 = 3,  //!< AVX-512 F + BW
+        ARCH_COUNT = 4    //!< Number of levels
+    };
+
+    /*!
+     * \brief The cpu_features class
+     *
+     *  Detects the CPU capabilities once and hands out the kernel variant to use for each
+     *  dispatched kernel. The class only contains static functions and thus doesn't need
+     *  a constructor.
+     *
+     *  Usage: each dispatched kernel keeps a table of function pointers indexed by #cpu_arch
+     *  and calls cpu_features::select() to get the best available variant. Missing entries
+     *  (nullptr) fall back to the next lower level.
+     */
+    class cpu_features
+    {
+    public:
+
+        /*!
+         * \brief Gets the highest level supported by this CPU.
+         */
+        static cpu_arch detected();
+
+        /*!
+         * \brief Gets the level currently selected for the kernels.
+         *
+         * On first use this is the detected level, unless the FUN_OFDM_ARCH environment
+         * variable is set to one of "generic", "sse2", "avx2" or "avx512".
+         */
+        static cpu_arch active();
+
+        /*!
+         * \brief Forces the kernels to use a given level.
+         * \param arch The level to use.
+         * \return false (and leaves the selection untouched) if the CPU doesn't support the level.
+         */
+        static bool force(cpu_arch arch);
+
+        /*!
+         * \brief Whether the AVX-512 kernels may use the VBMI byte permutes.
+         *
+         * Only true when the active level is #ARCH_AVX512 and the CPU supports AVX512-VBMI.
+         */
+        static bool has_avx512_vbmi();
+
+        /*!
+         * \brief Gets the display name of a level.
+         */
+        static const char * name(cpu_arch arch);
+
+        /*!
+         * \brief Selects the kernel variant for the active level.
+         * \param table Function pointers indexed by #cpu_arch, entries may be nullptr.
+         * \return The entry for the active level or the closest lower level that is set.
+         */
+        template<typename F>
+        static F select(const F (&table)[ARCH_COUNT])
+        {
+            for(int a = active(); a > ARCH_GENERIC; a--)
+            {
+                if(table[a]) return table[a];
+            }
+            return table[ARCH_GENERIC];
+        }
+    };
+}
+
+#endif // CPU_FEATURES_H
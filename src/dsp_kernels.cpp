@@ -0,0 +1,123 @@
+/*! \file dsp_kernels.cpp
+ *  \brief C++ file for the dsp_kernels class.
+ *
+ *  The dsp_kernels class holds the small vector kernels that sit in the inner loops of
+ *  the receive chain. Each kernel has a portable implementation plus variants compiled for
+ *  wider instruction sets; cpu_features picks one at runtime.
+ */
+
+#include <immintrin.h>
+
+#include "dsp_kernels.h"
+#include "cpu_features.h"
+
+#define DSP_INLINE inline __attribute__((always_inline))
+
+namespace fun
+{
+    /*
+     * The equalizer body is plain C++ that the compiler vectorizes on its own. It is force-inlined
+     * into each variant below so that every copy is compiled for that variant's instruction set.
+     */
+    static DSP_INLINE void equalize_body(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n)
+    {
+        const double * a = reinterpret_cast<const double *>(in);
+        const double * b = reinterpret_cast<const double *>(coef);
+        double * o = reinterpret_cast<double *>(out);
+        for(int j = 0; j < n; j++)
+        {
+            double ar = a[2*j], ai = a[2*j+1];
+            double br = b[2*j], bi = b[2*j+1];
+            o[2*j] = br * ar - bi * ai;
+            o[2*j+1] = br * ai + bi * ar;
+        }
+    }
+
+    static void equalize_generic(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n)
+    {
+        equalize_body(in, coef, out, n);
+    }
+
+    __attribute__((target("avx2")))
+    static void equalize_avx2(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n)
+    {
+        equalize_body(in, coef, out, n);
+    }
+
+    __attribute__((target("avx512f")))
+    static void equalize_avx512(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n)
+    {
+        equalize_body(in, coef, out, n);
+    }
+
+    static void correlate_generic(const tagged_sample * in, const std::complex<double> * ref_conj, int n, std::complex<double> & corr, double & power)
+    {
+        double corr_re = 0, corr_im = 0, pwr = 0;
+        for(int s = 0; s < n; s++)
+        {
+            double ar = in[s].sample.real(), ai = in[s].sample.imag();
+            double br = ref_conj[s].real(), bi = ref_conj[s].imag();
+            corr_re += ar * br - ai * bi;
+            corr_im += ar * bi + ai * br;
+            pwr += ar * ar + ai * ai;
+        }
+        corr = std::complex<double>(corr_re, corr_im);
+        power = pwr;
+    }
+
+    /*
+     * Two samples per register. A accumulates in * re(ref), B accumulates in * im(ref) so that
+     * corr = (A.re - B.im) + j(A.im + B.re). The tagged samples are 24 bytes apart, hence the
+     * two 128 bit loads per register.
+     */
+    __attribute__((target("avx2")))
+    static void correlate_avx2(const tagged_sample * in, const std::complex<double> * ref_conj, int n, std::complex<double> & corr, double & power)
+    {
+        __m256d acc_a = _mm256_setzero_pd();
+        __m256d acc_b = _mm256_setzero_pd();
+        __m256d acc_p = _mm256_setzero_pd();
+        int s = 0;
+        for(; s + 2 <= n; s += 2)
+        {
+            __m256d x = _mm256_set_m128d(_mm_loadu_pd(reinterpret_cast<const double *>(&in[s+1].sample)),
+                                         _mm_loadu_pd(reinterpret_cast<const double *>(&in[s].sample)));
+            __m256d r = _mm256_loadu_pd(reinterpret_cast<const double *>(&ref_conj[s]));
+            acc_a = _mm256_add_pd(acc_a, _mm256_mul_pd(x, _mm256_movedup_pd(r)));
+            acc_b = _mm256_add_pd(acc_b, _mm256_mul_pd(x, _mm256_permute_pd(r, 0xF)));
+            acc_p = _mm256_add_pd(acc_p, _mm256_mul_pd(x, x));
+        }
+
+        double a[4], b[4], p[4];
+        _mm256_storeu_pd(a, acc_a);
+        _mm256_storeu_pd(b, acc_b);
+        _mm256_storeu_pd(p, acc_p);
+        double corr_re = (a[0] + a[2]) - (b[1] + b[3]);
+        double corr_im = (a[1] + a[3]) + (b[0] + b[2]);
+        double pwr = p[0] + p[1] + p[2] + p[3];
+
+        for(; s < n; s++)
+        {
+            double ar = in[s].sample.real(), ai = in[s].sample.imag();
+            double br = ref_conj[s].real(), bi = ref_conj[s].imag();
+            corr_re += ar * br - ai * bi;
+            corr_im += ar * bi + ai * br;
+            pwr += ar * ar + ai * ai;
+        }
+        corr = std::complex<double>(corr_re, corr_im);
+        power = pwr;
+    }
+
+    void dsp_kernels::equalize(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n)
+    {
+        typedef void (*kernel)(const std::complex<double> *, const std::complex<double> *, std::complex<double> *, int);
+        static const kernel kernels[ARCH_COUNT] = { &equalize_generic, nullptr, &equalize_avx2, &equalize_avx512 };
+        cpu_features::select(kernels)(in, coef, out, n);
+    }
+
+    void dsp_kernels::correlate(const tagged_sample * in, const std::complex<double> * ref_conj, int n, std::complex<double> & corr, double & power)
+    {
+        typedef void (*kernel)(const tagged_sample *, const std::complex<double> *, int, std::complex<double> &, double &);
+        static const kernel kernels[ARCH_COUNT] = { &correlate_generic, nullptr, &correlate_avx2, nullptr };
+        cpu_features::select(kernels)(in, ref_conj, n, corr, power);
+    }
+}
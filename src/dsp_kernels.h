@@ -0,0 +1,49 @@
+/*! \file dsp_kernels.h
+ *  \brief Header file for the dsp_kernels class.
+ *
+ *  The dsp_kernels class holds the small vector kernels that sit in the inner loops of
+ *  the receive chain (channel equalization and LTS correlation). Each kernel has several
+ *  implementations and the one matching the CPU is picked at runtime by cpu_features.
+ */
+
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <complex>
+
+#include "tagged_vector.h"
+
+namespace fun
+{
+    /*!
+     * \brief The dsp_kernels class
+     *
+     *  Runtime dispatched DSP kernels. The class only contains static functions and thus
+     *  doesn't need a constructor.
+     */
+    class dsp_kernels
+    {
+    public:
+
+        /*!
+         * \brief Element-wise complex multiply, i.e. applies a per subcarrier channel correction.
+         * \param in Input samples.
+         * \param coef Correction coefficients.
+         * \param out Output samples (may alias in).
+         * \param n Number of samples.
+         */
+        static void equalize(const std::complex<double> * in, const std::complex<double> * coef, std::complex<double> * out, int n);
+
+        /*!
+         * \brief Cross correlates tagged samples against a (conjugated) reference.
+         * \param in Input samples.
+         * \param ref_conj Complex conjugate of the reference sequence.
+         * \param n Length of the reference sequence.
+         * \param corr Output: sum of in[s] * ref_conj[s].
+         * \param power Output: sum of |in[s]|^2.
+         */
+        static void correlate(const tagged_sample * in, const std::complex<double> * ref_conj, int n, std::complex<double> & corr, double & power);
+    };
+}
+
+#endif // DSP_KERNELS_H
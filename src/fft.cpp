@@ -9,6 +9,7 @@
 #include <assert.h>
 
 #include "fft.h"
+#include "cpu_features.h"
 
 namespace fun
 {
@@ -35,8 +36,13 @@ namespace fun
         m_fftw_out_forward = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * m_fft_length);
         m_fftw_in_inverse = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * m_fft_length);
         m_fftw_out_inverse = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * m_fft_length);
-        m_fftw_plan_forward = fftw_plan_dft_1d(m_fft_length, m_fftw_in_forward, m_fftw_out_forward, FFTW_FORWARD, FFTW_MEASURE);
-        m_fftw_plan_inverse = fftw_plan_dft_1d(m_fft_length, m_fftw_in_inverse, m_fftw_out_inverse, FFTW_BACKWARD, FFTW_MEASURE);
+
+        // FFTW picks its own SIMD codelets at plan time, only the generic override needs to be passed on
+        unsigned int flags = FFTW_MEASURE;
+        if(cpu_features::active() == ARCH_GENERIC) flags |= FFTW_NO_SIMD;
+
+        m_fftw_plan_forward = fftw_plan_dft_1d(m_fft_length, m_fftw_in_forward, m_fftw_out_forward, FFTW_FORWARD, flags);
+        m_fftw_plan_inverse = fftw_plan_dft_1d(m_fft_length, m_fftw_in_inverse, m_fftw_out_inverse, FFTW_BACKWARD, flags);
     }
 
 
@@ -67,10 +73,15 @@ namespace fun
      */
     void fft::inverse(std::vector<std::complex<double> > & data)
     {
-        assert(data.size() % m_fft_length == 0);
+        inverse(data.data(), data.size());
+    }
+
+    void fft::inverse(std::complex<double> * data, int count)
+    {
+        assert(count % m_fft_length == 0);
 
         // Run the IFFT on each m_fft_length samples
-        for(int x = 0; x < data.size(); x += m_fft_length)
+        for(int x = 0; x < count; x += m_fft_length)
         {
             if(m_fft_length == 64)
             {
@@ -89,11 +100,22 @@ namespace fun
         }
 
         // Scale by 1/fft_length
-        for(int x = 0; x < data.size(); x++)
+        for(int x = 0; x < count; x++)
         {
             data[x] /= m_fft_length;
         }
     }
-}
 
+    /*!
+     * The fft_map reordering swaps the two halves of the symbol, so it is done with two copies.
+     */
+    void fft::inverse_symbol(const std::complex<double> * subcarriers, std::complex<double> * samples)
+    {
+        assert(m_fft_length == 64);
 
+        memcpy(&m_fftw_in_inverse[0], &subcarriers[32], 32 * sizeof(std::complex<double>));
+        memcpy(&m_fftw_in_inverse[32], &subcarriers[0], 32 * sizeof(std::complex<double>));
+        fftw_execute(m_fftw_plan_inverse);
+        memcpy(samples, m_fftw_out_inverse, 64 * sizeof(std::complex<double>));
+    }
+}
@@ -47,6 +47,23 @@ namespace fun
          */
         void inverse(std::vector<std::complex<double> > & data);
 
+        /*!
+         * \brief In place inverse FFT of a caller provided buffer.
+         * \param data Complex doubles in frequency domain to be converted to time domain.
+         * \param count Number of samples, an integer multiple of #m_fft_length.
+         */
+        void inverse(std::complex<double> * data, int count);
+
+        /*!
+         * \brief Unscaled 64 point inverse FFT of one symbol into a separate buffer.
+         * \param subcarriers The 64 subcarriers in frequency domain, in the same order as for #inverse.
+         * \param samples Output for the 64 time domain samples.
+         *
+         * Unlike #inverse the output isn't scaled by 1/64, callers fold that into the amplitude of
+         * the subcarriers instead. Requires #m_fft_length to be 64.
+         */
+        void inverse_symbol(const std::complex<double> * subcarriers, std::complex<double> * samples);
+
     private:
 
         /*!
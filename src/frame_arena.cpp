@@ -0,0 +1,130 @@
+/*! \file frame_arena.cpp
+ *  \brief C++ file for the frame_arena class.
+ *
+ *  The frame_arena class is a resettable bump allocator for the per frame scratch buffers
+ *  of the encoder and the decoder.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "frame_arena.h"
+
+namespace fun
+{
+    static unsigned char * allocate_block(size_t size)
+    {
+        void * data = NULL;
+        if(posix_memalign(&data, FRAME_ARENA_ALIGNMENT, size)) throw std::bad_alloc();
+        return static_cast<unsigned char *>(data);
+    }
+
+    /*!
+     * -Initializations
+     *  + #m_blocks -> one block of initial_size bytes
+     *  + #m_current, #m_offset, #m_depth -> 0
+     */
+    frame_arena::frame_arena(size_t initial_size) :
+        m_current(0),
+        m_offset(0),
+        m_depth(0)
+    {
+        block b = { allocate_block(initial_size), initial_size };
+        m_blocks.push_back(b);
+    }
+
+    frame_arena::~frame_arena()
+    {
+        for(size_t b = 0; b < m_blocks.size(); b++) free(m_blocks[b].data);
+    }
+
+    void * frame_arena::allocate(size_t bytes)
+    {
+        bytes = (bytes + FRAME_ARENA_ALIGNMENT - 1) & ~size_t(FRAME_ARENA_ALIGNMENT - 1);
+        if(m_offset + bytes > m_blocks[m_current].size) next_block(bytes);
+
+        void * p = m_blocks[m_current].data + m_offset;
+        m_offset += bytes;
+        return p;
+    }
+
+    /*!
+     *  A block after the current one may be left over from a deeper scope that has been rolled
+     *  back. It is reused if it is big enough, otherwise it is replaced by one twice the size of
+     *  the current block.
+     */
+    void frame_arena::next_block(size_t bytes)
+    {
+        size_t size = std::max(bytes, 2 * m_blocks[m_current].size);
+        m_current++;
+        m_offset = 0;
+        if(m_current < m_blocks.size())
+        {
+            if(m_blocks[m_current].size >= bytes) return;
+            free(m_blocks[m_current].data);
+            m_blocks[m_current].data = allocate_block(size);
+            m_blocks[m_current].size = size;
+        }
+        else
+        {
+            block b = { allocate_block(size), size };
+            m_blocks.push_back(b);
+        }
+    }
+
+    void frame_arena::reset()
+    {
+        m_current = 0;
+        m_offset = 0;
+        if(m_blocks.size() == 1) return;
+
+        // Merge the blocks so that the next frame of this size fits into the first one
+        size_t total = capacity();
+        for(size_t b = 0; b < m_blocks.size(); b++) free(m_blocks[b].data);
+        m_blocks.resize(1);
+        m_blocks[0].data = allocate_block(total);
+        m_blocks[0].size = total;
+    }
+
+    size_t frame_arena::capacity() const
+    {
+        size_t total = 0;
+        for(size_t b = 0; b < m_blocks.size(); b++) total += m_blocks[b].size;
+        return total;
+    }
+
+    size_t frame_arena::used() const
+    {
+        size_t total = m_offset;
+        for(size_t b = 0; b < m_current; b++) total += m_blocks[b].size;
+        return total;
+    }
+
+    frame_arena & frame_arena::local()
+    {
+        static thread_local frame_arena arena;
+        return arena;
+    }
+
+    frame_arena::scope::scope(frame_arena & arena) :
+        m_arena(arena),
+        m_block(arena.m_current),
+        m_offset(arena.m_offset)
+    {
+        m_arena.m_depth++;
+    }
+
+    frame_arena::scope::~scope()
+    {
+        if(--m_arena.m_depth == 0)
+        {
+            m_arena.reset();
+        }
+        else
+        {
+            m_arena.m_current = m_block;
+            m_arena.m_offset = m_offset;
+        }
+    }
+}
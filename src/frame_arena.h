@@ -0,0 +1,128 @@
+/*! \file frame_arena.h
+ *  \brief Header file for the frame_arena class.
+ *
+ *  The frame_arena class is a resettable bump allocator for the scratch buffers that are
+ *  needed while a single frame is encoded or decoded (coded bits, interleaved bits, soft
+ *  bits, decoded bytes, ...). Each thread has its own arena, so handing out a buffer is a
+ *  pointer increment and releasing all of a frame's buffers is O(1).
+ */
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+#define FRAME_ARENA_ALIGNMENT 64       //!< Alignment of every buffer (a cache line / AVX-512 register)
+#define FRAME_ARENA_INITIAL_SIZE 65536 //!< Initial size of an arena in bytes
+
+namespace fun
+{
+    /*!
+     * \brief The frame_arena class
+     *
+     *  Buffers are carved out of one large block. If a frame needs more than the block holds
+     *  another block is added, and once the arena is reset the blocks are merged into a single
+     *  one that is big enough. After the first few frames of a given size the arena therefore
+     *  never calls malloc again.
+     *
+     *  Usage: open a frame_arena::scope at the start of a function and allocate its scratch
+     *  buffers from frame_arena::local(). Everything allocated inside the scope is released when
+     *  the scope closes. Scopes nest, e.g. ppdu::encode inside frame_builder::build_frame.
+     *  The buffers hold trivially copyable types only, no constructors or destructors are run.
+     */
+    class frame_arena
+    {
+    public:
+
+        /*!
+         * \brief Constructor for frame_arena
+         * \param initial_size Size of the first block in bytes.
+         */
+        explicit frame_arena(size_t initial_size = FRAME_ARENA_INITIAL_SIZE);
+
+        ~frame_arena(); //!< Frees the blocks
+
+        /*!
+         * \brief Gets a buffer.
+         * \param bytes Size of the buffer.
+         * \return Pointer to FRAME_ARENA_ALIGNMENT aligned, uninitialized memory that stays
+         *  valid until the enclosing scope closes. Throws std::bad_alloc if a block can't be allocated.
+         */
+        void * allocate(size_t bytes);
+
+        /*!
+         * \brief Gets a buffer of count elements of type T.
+         */
+        template<typename T>
+        T * allocate(size_t count)
+        {
+            return static_cast<T *>(allocate(count * sizeof(T)));
+        }
+
+        /*!
+         * \brief Releases every buffer and merges the blocks if the arena had to grow.
+         *
+         * Must not be called while a scope is open.
+         */
+        void reset();
+
+        size_t capacity() const; //!< Total size of the blocks in bytes
+
+        size_t used() const;     //!< Bytes currently handed out (including alignment padding)
+
+        /*!
+         * \brief Gets this thread's arena.
+         */
+        static frame_arena & local();
+
+        /*!
+         * \brief Releases everything allocated while it was open when it goes out of scope.
+         */
+        class scope
+        {
+        public:
+            /*!
+             * \brief Opens a scope.
+             * \param arena The arena whose allocations are released, by default this thread's.
+             */
+            explicit scope(frame_arena & arena = frame_arena::local());
+
+            ~scope(); //!< Rolls the arena back (or resets it if this is the outermost scope)
+
+        private:
+            scope(const scope &) = delete;
+            scope & operator=(const scope &) = delete;
+
+            frame_arena & m_arena; //!< The arena
+            size_t m_block;        //!< Block in use when the scope was opened
+            size_t m_offset;       //!< Offset into that block when the scope was opened
+        };
+
+    private:
+
+        /*!
+         * \brief A chunk of memory buffers are carved out of.
+         */
+        struct block
+        {
+            unsigned char * data; //!< The memory
+            size_t size;          //!< Size in bytes
+        };
+
+        std::vector<block> m_blocks; //!< The blocks, m_blocks[0] is the one used after a reset
+        size_t m_current;            //!< Block that buffers are currently taken from
+        size_t m_offset;             //!< First free byte in the current block
+        int m_depth;                 //!< Number of open scopes
+
+        /*!
+         * \brief Moves on to a block after the current one that has room for bytes.
+         */
+        void next_block(size_t bytes);
+
+        frame_arena(const frame_arena &) = delete;
+        frame_arena & operator=(const frame_arena &) = delete;
+    };
+}
+
+#endif // FRAME_ARENA_H
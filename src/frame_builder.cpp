@@ -13,7 +13,6 @@
  */
 
 #include <arpa/inet.h>
-#include <boost/crc.hpp>
 
 #include "frame_builder.h"
 #include "interleaver.h"
@@ -27,58 +26,183 @@
 #include "parity.h"
 #include "modulator.h"
 #include "puncturer.h"
+#include "scrambler.h"
+#include "frame_arena.h"
 
 
-#define preamble_length 256 //!< Not cyclic prefixed at this point yet
-
 namespace fun
 {
     /*!
     * -Initializations
     *  + #m_ifft -> 64 point IFFT object
+    *  + #m_amplitude -> amplitude
+    *  + #m_pilots -> pilots scaled like the data subcarriers, i.e. by amplitude / 64
+    *  + #m_preamble -> preamble scaled by amplitude
+    *  + #m_cache_limit -> FRAME_CACHE_DEFAULT_SIZE
     */
-    frame_builder::frame_builder() :
-        m_ifft(64)
+    frame_builder::frame_builder(double amplitude) :
+        m_ifft(64),
+        m_amplitude(amplitude),
+        m_pilots(amplitude / 64),
+        m_preamble(&PREAMBLE_SAMPLES[0], &PREAMBLE_SAMPLES[320]),
+        m_cache_size(0),
+        m_cache_limit(FRAME_CACHE_DEFAULT_SIZE)
+    {
+        for(int x = 0; x < 320; x++) m_preamble[x] *= amplitude;
+    }
+
+    /*!
+     * The build_frame function first looks for the payload in the waveform cache. A hit returns a copy
+     * of the cached samples. Otherwise a copy of the most recently used frame with the same rate and
+     * length is patched if few enough of its symbols change, else the frame is built from scratch with
+     * #encode_frame. Either way the new frame is added at the front of the cache and the frame it was
+     * patched from stays cached, so payloads that take turns keep hitting.
+     */
+    std::vector<std::complex<double> > frame_builder::build_frame(const std::vector<unsigned char> & payload, Rate rate)
     {
+        if(m_cache_limit == 0) return encode_frame(payload, rate);
+
+        // Return the cached frame if the payload has been sent before
+        unsigned long long key = cache_key(payload, rate);
+        std::unordered_map<unsigned long long, std::list<cached_frame>::iterator>::iterator hit = m_cache_index.find(key);
+        if(hit != m_cache_index.end())
+        {
+            std::list<cached_frame>::iterator frame = hit->second;
+            if(frame->payload == payload)
+            {
+                m_cache.splice(m_cache.begin(), m_cache, frame);
+                return frame->samples;
+            }
+
+            // A different payload with the same CRC, the new one takes over the key
+            evict(frame);
+        }
+
+        // Patch a copy of the most recent frame of the same rate and length, or build a new frame
+        cached_frame frame;
+        frame.key = key;
+        frame.payload = payload;
+        frame.rate = rate;
+
+        std::list<cached_frame>::iterator base = m_cache.begin();
+        while(base != m_cache.end() && (base->rate != rate || base->payload.size() != payload.size())) base++;
+        if(base == m_cache.end() || !patch_frame(*base, payload, frame.samples))
+            frame.samples = encode_frame(payload, rate);
+
+        // Make room for the new frame
+        if(frame.bytes() > m_cache_limit) return frame.samples;
+        while(m_cache_size + frame.bytes() > m_cache_limit) evict(--m_cache.end());
+
+        m_cache_size += frame.bytes();
+        m_cache.push_front(std::move(frame));
+        m_cache_index[key] = m_cache.begin();
+        return m_cache.front().samples;
     }
 
     /*!
-     * The build_frame function is the main function where the input data is converted to the raw
+     * The encode_frame function is the main function where the input data is converted to the raw
      * output samples. The ppdu class is used to append the PHY header, scramble, convolutional code,
-     * interleaves, and modulates the input data.  The symbol mapper converts the modulated data into
-     * symbols and maps the data, pilots, and nulls to their respective subcarriers. The IFFT performs
-     * and IFFT (go figure). The cyclic prefixes are added and finally the preamble is prepended to
-     * complete the frame which is then returned to be passed to the usrp block.
+     * interleave, and modulate the input data onto the data subcarriers of each symbol, with the
+     * constellation already scaled by the amplitude and the 1/64 of the IFFT. The subcarriers live in
+     * the frame arena, from there #write_symbols puts each symbol straight into its place in the
+     * frame behind the preamble.
      */
-    std::vector<std::complex<double> > frame_builder::build_frame(std::vector<unsigned char> payload, Rate rate)
+    std::vector<std::complex<double> > frame_builder::encode_frame(const std::vector<unsigned char> & payload, Rate rate)
     {
-        //Append header, scramble, code, interleave, & modulate
-        ppdu ppdu_frame(payload, rate);        
-        std::vector<std::complex<double> > samples = ppdu_frame.encode();
+        ppdu ppdu_frame(payload, rate);
+        int symbol_count = ppdu_frame.get_num_symbols() + 1;
+
+        // Prepend the preamble
+        std::vector<std::complex<double> > frame(320 + symbol_count * 80);
+        memcpy(&frame[0], m_preamble.data(), 320 * sizeof(std::complex<double>));
 
-        // Map the subcarriers and insert pilots
-        symbol_mapper mapper = symbol_mapper();
-        std::vector<std::complex<double> > mapped = mapper.map(samples);
+        //Append header, scramble, code, interleave, & modulate straight onto the data subcarriers
+        frame_arena::scope scope;
+        std::complex<double> * mapped = frame_arena::local().allocate<std::complex<double> >(symbol_count * 64);
+        ppdu_frame.encode_subcarriers(mapped, m_amplitude / 64);
 
-        // Perform the IFFT
-        m_ifft.inverse(mapped);
+        // Pilots, IFFT and cyclic prefix of every symbol
+        write_symbols(mapped, 0, symbol_count - 1, frame.data());
+        return frame;
+    }
 
-        // Add the cyclic prefixes
-        std::vector<std::complex<double> > prefixed(mapped.size() * 80 / 64);
-        for(int x = 0; x < mapped.size() / 64; x++)
+    /*!
+     * Each symbol goes from the subcarrier grid straight into the frame: the pilots and nulls come
+     * from #m_pilots, the IFFT writes the 64 samples behind the cyclic prefix and the prefix is copied
+     * from the end of those. The subcarriers already carry the 1/64 of the IFFT and the amplitude,
+     * so nothing is scaled afterwards.
+     */
+    void frame_builder::write_symbols(std::complex<double> * mapped, int first, int last, std::complex<double> * frame)
+    {
+        for(int x = first; x <= last; x++)
         {
-            memcpy(&prefixed[x*80], &mapped[x*64+48], 16*sizeof(std::complex<double>));
-            memcpy(&prefixed[x*80+16], &mapped[x*64], 64*sizeof(std::complex<double>));
+            symbol_mapper::map_pilots(&mapped[x*64], 1, x, m_pilots);
+            std::complex<double> * symbol = &frame[320 + x*80];
+            m_ifft.inverse_symbol(&mapped[x*64], &symbol[16]);
+            memcpy(&symbol[0], &symbol[64], 16 * sizeof(std::complex<double>));
         }
+    }
 
-        // Prepend the preamble
-        std::vector<std::complex<double> > frame(prefixed.size() + 320);
+    /*!
+     * The scrambler, the puncturer and the interleaver all work on fixed positions and the
+     * convolutional code has a memory of K-1 bits, so DATA symbol s only depends on the data bits
+     * s * dbps - (K-1) to (s + 1) * dbps - 1. Besides the symbols that reach the changed bytes only
+     * the ones that reach the CRC change. The bit pipeline is cheap next to the IFFT, so the whole
+     * DATA field is encoded again and only the changed symbols are mapped, transformed and copied
+     * into the copy of the frame. The result is identical to building the frame from scratch.
+     */
+    bool frame_builder::patch_frame(const cached_frame & base, const std::vector<unsigned char> & payload, std::vector<std::complex<double> > & samples)
+    {
+        // Find the changed bytes
+        int length = payload.size();
+        int first = 0, last = length - 1;
+        while(first < length && payload[first] == base.payload[first]) first++;
+        while(last > first && payload[last] == base.payload[last]) last--;
+        assert(first < length);
 
-        memcpy(&frame[0], &PREAMBLE_SAMPLES[0], 320 * sizeof(std::complex<double>));
-        memcpy(&frame[320], &prefixed[0], prefixed.size() * sizeof(std::complex<double>));
+        // The DATA symbols (the SIGNAL symbol is 0) that reach the changed bytes and the CRC
+        ppdu ppdu_frame(payload, base.rate);
+        int symbol_count = ppdu_frame.get_num_symbols() + 1;
+        int dbps = RateParams(base.rate).dbps;
+        int ranges[2][2] = {
+            { 1 + (2 /* service */ + first) * 8 / dbps, 1 + ((2 /* service */ + last + 1) * 8 + K - 2) / dbps },
+            { 1 + (2 /* service */ + length) * 8 / dbps, 1 + ((2 /* service */ + length + 4 /* CRC */) * 8 + K - 2) / dbps }
+        };
+        ranges[0][1] = std::min(ranges[0][1], symbol_count - 1);
+        ranges[1][0] = std::max(ranges[1][0], ranges[0][1] + 1);
+        ranges[1][1] = std::min(ranges[1][1], symbol_count - 1);
 
-        // Return the samples
-        return frame;
+        int changed = 0;
+        for(int r = 0; r < 2; r++) changed += std::max(0, ranges[r][1] - ranges[r][0] + 1);
+        if(2 * changed >= symbol_count - 1) return false;
+
+        // Encode the new payload onto the data subcarriers
+        frame_arena::scope scope;
+        std::complex<double> * mapped = frame_arena::local().allocate<std::complex<double> >(symbol_count * 64);
+        ppdu_frame.encode_subcarriers(mapped, m_amplitude / 64);
+
+        samples = base.samples;
+        for(int r = 0; r < 2; r++)
+            if(ranges[r][0] <= ranges[r][1]) write_symbols(mapped, ranges[r][0], ranges[r][1], samples.data());
+        return true;
     }
-}
 
+    void frame_builder::set_cache_size(size_t bytes)
+    {
+        m_cache_limit = bytes;
+        while(m_cache_size > m_cache_limit) evict(--m_cache.end());
+    }
+
+    unsigned long long frame_builder::cache_key(const std::vector<unsigned char> & payload, Rate rate)
+    {
+        unsigned long long crc = scrambler::crc32(payload.data(), payload.size());
+        return (crc << 32) | ((unsigned long long)payload.size() << 8) | rate;
+    }
+
+    void frame_builder::evict(std::list<cached_frame>::iterator frame)
+    {
+        m_cache_size -= frame->bytes();
+        m_cache_index.erase(frame->key);
+        m_cache.erase(frame);
+    }
+}
@@ -18,9 +18,14 @@
 
 #include <vector>
 #include <complex>
+#include <list>
+#include <unordered_map>
 
 #include "fft.h"
 #include "rates.h"
+#include "symbol_mapper.h"
+
+#define FRAME_CACHE_DEFAULT_SIZE (8 * 1024 * 1024) //!< Default memory budget of the waveform cache in bytes
 
 namespace fun
 {
@@ -42,6 +47,12 @@ namespace fun
      *  convert it to time domain an a cyclic prefix is attached to each symbol. Finally, the symbols are
      *  concatenated together and a preamble is prepended to complete the frame. The frame is then returned
      *  so that it can be passed to the USRP for transmission.
+     *
+     *  Built frames are kept in a waveform cache with LRU eviction, so resending a payload (beacons,
+     *  test packets, ...) only copies the samples. A payload that only differs from a cached one of
+     *  the same rate and length in a few bytes (e.g. a sequence number) is built by patching a copy
+     *  of that frame: only the symbols that those bytes and the CRC reach go through the IFFT again.
+     *  The patched frame is cached as a frame of its own.
      */
     class frame_builder
     {
@@ -49,8 +60,10 @@ namespace fun
 
         /*!
          * \brief Constructor for frame_builder class
+         * \param amplitude [Optional] Factor for all samples of the frames, e.g. usrp_params::tx_amp.
+         *  It is folded into the constellation, pilots and preamble rather than applied to the frame.
          */
-        frame_builder();
+        frame_builder(double amplitude = 1.0);
 
         /*!
          * \brief Main function for building a PHY frame
@@ -59,12 +72,83 @@ namespace fun
          * \return A vector of complex doubles representing the digital base-band time domain signal
          *  to be passed to the usrp class for up-conversion and transmission over the air.
          */
-        std::vector<std::complex<double> >  build_frame(std::vector<unsigned char> payload, Rate rate);
+        std::vector<std::complex<double> >  build_frame(const std::vector<unsigned char> & payload, Rate rate);
+
+        /*!
+         * \brief Sets the memory budget of the waveform cache.
+         * \param bytes Maximum size of the cached frames in bytes, 0 disables the cache.
+         *
+         * Least recently used frames are evicted until the cache fits, frames that are larger
+         * than the whole budget are never cached. Defaults to #FRAME_CACHE_DEFAULT_SIZE.
+         */
+        void set_cache_size(size_t bytes);
 
     private:
 
+        /*!
+         * \brief A built frame in the waveform cache.
+         */
+        struct cached_frame
+        {
+            unsigned long long key;                      //!< CRC-32, length and rate of the payload, see #cache_key
+            std::vector<unsigned char> payload;          //!< The payload the frame was built from
+            Rate rate;                                   //!< The PHY rate the frame was built with
+            std::vector<std::complex<double> > samples;  //!< The frame, as returned by #build_frame
+
+            size_t bytes() const { return sizeof(cached_frame) + payload.size() + samples.size() * sizeof(std::complex<double>); } //!< Memory used by the frame
+        };
+
+        /*!
+         * \brief Builds a frame without looking at the cache.
+         */
+        std::vector<std::complex<double> > encode_frame(const std::vector<unsigned char> & payload, Rate rate);
+
+        /*!
+         * \brief Inserts the pilots and nulls of symbols, transforms them and writes them with their
+         *  cyclic prefix into a frame.
+         * \param mapped The subcarriers of the frame's symbols, see ppdu::encode_subcarriers.
+         * \param first Index of the first symbol to write (the SIGNAL symbol is 0).
+         * \param last Index of the last symbol to write.
+         * \param frame The frame, starting with the preamble.
+         */
+        void write_symbols(std::complex<double> * mapped, int first, int last, std::complex<double> * frame);
+
+        /*!
+         * \brief Builds a frame by patching a copy of a cached frame of the same rate and length.
+         * \param base The cached frame, it isn't changed.
+         * \param payload The new payload, must differ from the frame's payload.
+         * \param samples Output for the new frame.
+         * \return false, leaving samples alone, if at least half of the DATA symbols would change.
+         *  Building the frame from scratch is about as fast then.
+         */
+        bool patch_frame(const cached_frame & base, const std::vector<unsigned char> & payload, std::vector<std::complex<double> > & samples);
+
+        /*!
+         * \brief Key of a payload in #m_cache_index.
+         */
+        static unsigned long long cache_key(const std::vector<unsigned char> & payload, Rate rate);
+
+        /*!
+         * \brief Drops a frame from the cache.
+         */
+        void evict(std::list<cached_frame>::iterator frame);
+
         fft m_ifft; //!< The fft instance used to perform the inverse FFT on the OFDM symbols
 
+        double m_amplitude; //!< Factor for all samples of the frames
+
+        symbol_mapper::pilot_templates m_pilots; //!< Pilots of each symbol index, scaled like the data subcarriers
+
+        std::vector<std::complex<double> > m_preamble; //!< The preamble scaled by #m_amplitude
+
+        std::list<cached_frame> m_cache; //!< Cached frames, most recently used first
+
+        std::unordered_map<unsigned long long, std::list<cached_frame>::iterator> m_cache_index; //!< Cached frames by #cache_key
+
+        size_t m_cache_size;  //!< Memory used by the cached frames in bytes
+
+        size_t m_cache_limit; //!< Memory budget of the cache in bytes
+
     };
 }
 
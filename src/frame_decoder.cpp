@@ -7,8 +7,8 @@
 
 #include <iostream>
 #include <cstring>
+#include <utility>
 #include <arpa/inet.h>
-#include <boost/crc.hpp>
 
 #include "frame_decoder.h"
 #include "qam.h"
@@ -20,6 +20,8 @@
 #include "puncturer.h"
 #include "interleaver.h"
 #include "ppdu.h"
+#include "scrambler.h"
+#include "signal_decoder.h"
 
 namespace fun
 {
@@ -34,57 +36,99 @@ namespace fun
         m_current_frame.Reset(RateParams(RATE_1_2_BPSK), 0, 0);
     }
 
+    void frame_decoder::set_filter(const frame_filter & filter)
+    {
+        m_filter = filter;
+        m_filter_bytes.resize(filter.length);
+    }
+
+    /*!
+     * The filtered bytes are only compared once the streaming Viterbi decoder has handed all of
+     * them out, these are the final decoded bytes so the outcome is the same as filtering the
+     * decoded payload. They are descrambled into #m_filter_bytes because FrameData::data gets descrambled
+     * in place at the end of the frame.
+     */
+    bool frame_decoder::check_filter()
+    {
+        FrameData & f = m_current_frame;
+        if(f.filtered) return true;
+
+        int start = 2 /* service */ + m_filter.offset;
+        if(f.data_bytes < start + m_filter.length) return true;
+
+        f.filtered = true;
+        scrambler::scramble(&f.data[start], m_filter_bytes.data(), m_filter.length, start);
+        return m_filter.matches(m_filter_bytes.data());
+    }
+
     /*!
      * When a start of frame is detected this block first attempts to decode the ppdu header.
      * If that is successful as determined by a simple parity check on the header bits it
-     * then tries to decode the payload of the frame using the parameters it gathered from
-     * header.  If that is successful as deteremined by an IEEE CRC-32 check, the decoded payload
-     * is passed to the output_buffer to be returned to the receive chain so that it can be passed
-     * up to the MAC layer.
+     * then decodes the payload of the frame symbol by symbol using the parameters it gathered
+     * from the header: every symbol is demodulated, deinterleaved and depunctured as soon as
+     * it arrives and fed to the streaming Viterbi decoder. If a frame_filter is set, frames that
+     * can't match it are dropped after the header and frames that don't match it as soon as the
+     * filtered bytes are decoded, so the rest of their symbols are skipped. Once the last symbol
+     * is in only the end of the traceback is left. If the payload passes the IEEE CRC-32 check, it is passed
+     * to the output_buffer to be returned to the receive chain so that it can be passed up to
+     * the MAC layer.
      */
     void frame_decoder::work()
     {
-        if(input_buffer.size() == 0) return;
+        // Drop the previous call's payloads first so that their buffers can go back to the pool
         output_buffer.resize(0);
+        if(input_buffer.size() == 0) return;
+
+        FrameData & f = m_current_frame;
 
         // Step through each 48 sample symbol
         for(int x = 0; x < input_buffer.size(); x++)
         {
-            // Copy over available symbols
-            if(m_current_frame.samples_copied < m_current_frame.sample_count)
+            // Decode available symbols
+            if(f.symbols_decoded < f.symbol_count)
             {
-                memcpy(&m_current_frame.samples[m_current_frame.samples_copied], &input_buffer[x].samples[0], 48 * sizeof(std::complex<double>));
-                m_current_frame.samples_copied += 48;
-            }
+                unsigned char demodulated[288 /* largest cbps */];
+                f.demodulate(input_buffer[x].samples, input_buffer[x].csi, demodulated, 48);
+                interleaver::deinterleave_depuncture(demodulated, f.soft_bits.data(), f.rate_params.cbps, f.rate_params);
+                f.data_bytes += m_data_decoder.stream_decode(f.soft_bits.data(), f.soft_bits.size(), &f.data[f.data_bytes]);
+                f.symbols_decoded++;
 
-            // Decode the frame if possible
-            if(m_current_frame.samples_copied >= m_current_frame.sample_count && m_current_frame.sample_count != 0)
-            {
-                ppdu frame = ppdu(m_current_frame.rate_params.rate, m_current_frame.length);
-                if(frame.decode_data(m_current_frame.samples))
+                // Drop the frame as soon as it is known not to be for us
+                if(m_filter.length && !check_filter())
                 {
-                    output_buffer.push_back(frame.get_payload());
+                    f.symbol_count = 0;
+                    f.symbols_decoded = 0;
+                }
+
+                // Finish the frame with the last symbol
+                else if(f.symbols_decoded == f.symbol_count)
+                {
+                    f.data_bytes += m_data_decoder.stream_end(&f.data[f.data_bytes]);
+
+                    ppdu frame = ppdu(f.rate_params.rate, f.length);
+                    payload_buffer payload;
+                    if((!m_filter.length || check_filter()) && frame.descramble_data(f.data.data(), payload))
+                    {
+                        output_buffer.push_back(std::move(payload));
+                    }
+                    f.symbol_count = 0;
+                    f.symbols_decoded = 0;
                 }
-                m_current_frame.sample_count = 0;
             }
 
             // Look for a start of frame
             if(input_buffer[x].tag == START_OF_FRAME)
             {
                 // Attempt to decode the header
-                ppdu h = ppdu();
-                std::vector<std::complex<double> > header_samples(48);
-                memcpy(header_samples.data(), input_buffer[x].samples, 48 * sizeof(std::complex<double>));
-                if(!h.decode_header(header_samples)) continue;
+                plcp_header h;
+                if(!signal_decoder::decode(input_buffer[x].samples, input_buffer[x].csi, h)) continue;
 
-                // Calculate the frame sample count
-                int length = h.get_length();
-                RateParams rate_params = RateParams(h.get_rate());
-                int frame_sample_count = h.get_num_symbols() * 48;
+                // A payload that ends before the filtered bytes can't match the filter
+                if(m_filter.length && h.length < m_filter.offset + m_filter.length) continue;
 
                 // Start a new frame
-                m_current_frame.Reset(rate_params, frame_sample_count, length);
-                m_current_frame.samples.resize(h.get_num_symbols() * 48);
+                f.Reset(RateParams(h.rate), h.num_symbols, h.length);
+                if(!m_data_decoder.stream_begin()) f.symbol_count = 0;
                 continue;
             }
         }
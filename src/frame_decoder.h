@@ -14,26 +14,86 @@
 
 #include <complex>
 #include <deque>
+#include <cstring>
 
 #include "tagged_vector.h"
 #include "rates.h"
 #include "block.h"
+#include "viterbi.h"
+#include "modulator.h"
+#include "payload_pool.h"
 
 namespace fun
 {
+    /*!
+     * \brief The frame_filter struct selects the frames that get decoded completely.
+     *
+     * The filter compares a range of payload bytes, e.g. the receiver address of the MAC header
+     * at offset 4, against a set of accepted values. The frame_decoder checks it as soon as the
+     * streaming Viterbi decoder has handed out those bytes and drops frames that don't match
+     * without decoding the rest of their symbols. A filter of length 0 accepts every frame.
+     */
+    struct frame_filter
+    {
+        int offset;                         //!< Offset of the filtered bytes in the payload
+        int length;                         //!< Number of filtered bytes, 0 disables the filter
+        std::vector<unsigned char> values;  //!< Accepted values, #length bytes each back to back
+
+        /*!
+         * \brief Constructor for a filter.
+         * \param _offset Offset of the filtered bytes in the payload.
+         * \param _length Number of filtered bytes, 0 (the default) for a filter that accepts every frame.
+         *
+         * The filter doesn't accept any frame with a nonzero length until values are added with #accept.
+         */
+        frame_filter(int _offset = 0, int _length = 0) :
+            offset(_offset),
+            length(_length)
+        {
+        }
+
+        /*!
+         * \brief Adds an accepted value.
+         * \param value #length bytes that the filtered bytes may be equal to.
+         */
+        void accept(const unsigned char * value)
+        {
+            values.insert(values.end(), value, value + length);
+        }
+
+        /*!
+         * \brief Checks the filtered bytes of a payload.
+         * \param bytes The #length filtered bytes, i.e. the payload bytes starting at #offset.
+         * \return Whether the bytes are equal to one of the accepted values.
+         */
+        bool matches(const unsigned char * bytes) const
+        {
+            for(size_t v = 0; v < values.size(); v += length)
+            {
+                if(memcmp(&values[v], bytes, length) == 0) return true;
+            }
+            return false;
+        }
+    };
+
     /*!
      * \brief The FrameData struct
      *
-     * This struct keeps track of frame parameters such as length etc.
+     * This struct keeps track of frame parameters such as length etc. The frame is decoded
+     * symbol by symbol as the symbols arrive, so only the soft bits of one symbol and the
+     * bytes that the streaming Viterbi decoder has already handed out are kept.
      */
     struct FrameData
     {
-      int sample_count;                          //!< Number of samples in this frame
-      int samples_copied;                        //!< Number of samples already copied
+      int symbol_count;                          //!< Number of OFDM symbols in this frame
+      int symbols_decoded;                       //!< Number of symbols already fed to the decoder
       RateParams rate_params;                    //!< Rate parameters for this frame
-      std::vector<std::complex<double> > samples; //!< Decoded Samples
+      modulator::demodulate_csi_kernel demodulate; //!< Demodulator for this frame's modulation
       int length;                                //!< Data length
-      int required_samples;                      //!< Number of samples required to decode frame
+      std::vector<unsigned char> soft_bits;      //!< Soft bits of the current symbol, deinterleaved and depunctured
+      std::vector<unsigned char> data;           //!< Decoded bytes of the DATA field
+      int data_bytes;                            //!< Number of bytes in #data that are decoded
+      bool filtered;                             //!< Whether the frame already passed the frame_filter
 
       /*!
        * \brief Constructor for FrameData
@@ -42,33 +102,36 @@ namespace fun
       FrameData(RateParams _rate_params) :
         rate_params(_rate_params)
       {
-        samples.reserve(100000);
       }
 
       /*!
        * \brief Resets the parameters of the object to the new parameters provided
        * \param _rate_params new rate parameters for this frame
-       * \param _sample_count new sample count for this frame
+       * \param _symbol_count new symbol count for this frame
        * \param _length new length for this frame
        *
-       * Also calculates #required_samples from the above parameters and resets
-       * #samples_copied to 0.
+       * Also picks the demodulator, sizes the buffers for the frame and resets #symbols_decoded,
+       * #data_bytes and #filtered.
        */
-      void Reset(RateParams _rate_params, int _sample_count, int _length)
+      void Reset(RateParams _rate_params, int _symbol_count, int _length)
       {
           rate_params = _rate_params;
+          demodulate = modulator::get_demodulate_csi_kernel(_rate_params.rate);
           length = _length;
-          sample_count = _sample_count;
-          required_samples = _sample_count / _rate_params.bpsc;
-          samples_copied = 0;
+          symbol_count = _symbol_count;
+          symbols_decoded = 0;
+          data_bytes = 0;
+          filtered = false;
+          soft_bits.resize(2 * _rate_params.dbps);
+          data.resize(_symbol_count * _rate_params.dbps / 8 + 16 /* stream decoder slack */);
       }
     };
 
     /*!
      * \brief The frame_decoder block.
      *
-     * Inputs tagged_vector<48> from phase_tracker block.
-     * Outputs std::vector<unsigned char> back to the receiver chain
+     * Inputs tagged_csi_vector<48> from phase_tracker block.
+     * Outputs payload_buffer (the payload bytes, from the payload_pool) back to the receiver chain
      *
      * The Frame Decoder block is in charge of decoding the frame header and then the frame body.
      * This includes demodulating, deinterleaving, de-convolutional-coding, and descrambling.
@@ -77,7 +140,7 @@ namespace fun
      * decoding the frame as determined by an IEEE CRC-32 check the payload is passed into
      * the output_buffer as unsigned char's or bytes.
      */
-    class frame_decoder : public fun::block<tagged_vector<48>, std::vector<unsigned char> >
+    class frame_decoder : public fun::block<tagged_csi_vector<48>, payload_buffer>
     {
     public:
 
@@ -85,10 +148,31 @@ namespace fun
 
         virtual void work(); //!< Signal processing happens here.
 
+        /*!
+         * \brief Sets the filter that frames have to pass to be decoded completely.
+         * \param filter The new filter, frame_filter() to decode every frame.
+         *
+         * Must not be called while #work is running. Frames that don't match the filter are
+         * dropped before their CRC is checked, so they never reach the output_buffer.
+         */
+        void set_filter(const frame_filter & filter);
+
     private:
 
+        /*!
+         * \brief Checks the current frame against #m_filter once its filtered bytes are decoded.
+         * \return False if the frame doesn't match the filter and should be dropped.
+         */
+        bool check_filter();
+
         FrameData m_current_frame; //!< Current frame that is being decoded.
 
+        frame_filter m_filter; //!< Frames that don't match this are dropped early.
+
+        std::vector<unsigned char> m_filter_bytes; //!< The filtered bytes of the current frame, descrambled.
+
+        viterbi m_data_decoder; //!< Viterbi decoder reused for every payload.
+
     };
 
 }
@@ -2,39 +2,267 @@
  *  \brief C++ file for the Interleaver class.
  *
  * The interleaver class performs interleaving as described in section 17.3.5.6 of
- * the 802.11a-1999 standard. The Interleaver class contains two static functions:
- * interleave and deinterleave and thus doesn't need a constructor. However, it does
- * use the BitInterleave struct as a helper for these two functions.
+ * the 802.11a-1999 standard. The Interleaver class contains static functions:
+ * interleave and deinterleave and thus doesn't need a constructor. The permutation
+ * tables of each rate are built at compile time.
  */
 
+#include <cstring>
+#include <immintrin.h>
+
 #include "interleaver.h"
+#include "cpu_features.h"
+#include "puncturer.h"
 
 namespace fun
 {
-    // Interleave some data
-    std::vector<unsigned char> interleaver::interleave(std::vector<unsigned char> data)
+    /*
+     * 17.3.5.6 in 802.11a-1999, floor is implicit. k is the index of a coded bit before
+     * interleaving, j its index after interleaving. s = max(bpsc/2, 1).
+     */
+    static constexpr int interleave_s(int bpsc) { return bpsc / 2 > 1 ? bpsc / 2 : 1; }
+
+    static constexpr int interleave_j(int cbps, int s, int i) { return s * (i / s) + (i + cbps - (16 * i / cbps)) % s; }
+
+    static constexpr int interleave_index(int cbps, int bpsc, int k)
+    {
+        return interleave_j(cbps, interleave_s(bpsc), (cbps / 16) * (k % 16) + k / 16);
+    }
+
+    static constexpr int deinterleave_i(int cbps, int s, int j) { return s * (j / s) + (j + 16 * j / cbps) % s; }
+
+    static constexpr int deinterleave_k(int cbps, int i) { return 16 * i - (cbps - 1) * (16 * i / cbps); }
+
+    static constexpr int deinterleave_index(int cbps, int bpsc, int j)
+    {
+        return deinterleave_k(cbps, deinterleave_i(cbps, interleave_s(bpsc), j));
+    }
+
+    template<int... I> struct index_list {};
+    template<int N, int... I> struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+    template<int... I> struct make_index_list<0, I...> { typedef index_list<I...> type; };
+
+    /*!
+     * \brief The permutation of one rate, as gather tables.
+     *
+     * Interleaving sets out[j] = in[gather_interleave[j]], deinterleaving sets
+     * out[k] = in[gather_deinterleave[k]].
+     */
+    template<int CBPS, int BPSC, class L = typename make_index_list<CBPS>::type> struct interleave_table;
+
+    template<int CBPS, int BPSC, int... I>
+    struct interleave_table<CBPS, BPSC, index_list<I...> >
+    {
+        static constexpr unsigned short gather_interleave[CBPS] = { deinterleave_index(CBPS, BPSC, I)... };
+        static constexpr unsigned short gather_deinterleave[CBPS] = { interleave_index(CBPS, BPSC, I)... };
+    };
+
+    template<int CBPS, int BPSC, int... I>
+    constexpr unsigned short interleave_table<CBPS, BPSC, index_list<I...> >::gather_interleave[CBPS];
+
+    template<int CBPS, int BPSC, int... I>
+    constexpr unsigned short interleave_table<CBPS, BPSC, index_list<I...> >::gather_deinterleave[CBPS];
+
+    static_assert(interleave_table<48, 1>::gather_interleave[interleave_index(48, 1, 5)] == 5, "interleaver tables are not inverse");
+    static_assert(interleave_table<288, 6>::gather_interleave[interleave_index(288, 6, 200)] == 200, "interleaver tables are not inverse");
+
+    // Largest symbol in 64 byte registers, before and after depuncturing (288 / (2/3) = 432 bits)
+    #define INTERLEAVE_MAX_REGS 5
+    #define DEPUNCTURE_MAX_REGS 7
+
+    // Gather entry of an output that is a puncture hole
+    #define GATHER_ERASURE 0xFFFF
+
+    // Soft value of a puncture hole
+    #define ERASURE 127
+
+    /*!
+     * \brief A gather table laid out for the AVX-512 VBMI byte permutes.
+     *
+     * The input symbol is split into 128 byte windows (register pairs). Each 64 byte output
+     * chunk is permuted out of every window with vpermi2b and the results are merged with
+     * the masks of the output bytes that come from that window. Outputs that don't come
+     * from any window are erasures.
+     */
+    struct interleave_simd_table
+    {
+        int in_regs;                                          //!< 64 byte input registers per symbol
+        int out_regs;                                         //!< 64 byte output registers per symbol
+        unsigned char idx[DEPUNCTURE_MAX_REGS][64];           //!< Source index modulo 128
+        unsigned long long mask[DEPUNCTURE_MAX_REGS][(INTERLEAVE_MAX_REGS + 1) / 2]; //!< Output bytes taken from each window
+        unsigned long long valid[DEPUNCTURE_MAX_REGS];        //!< Output bytes that aren't erasures
+
+        void init(const unsigned short * gather, int in_count, int out_count)
+        {
+            in_regs = (in_count + 63) / 64;
+            out_regs = (out_count + 63) / 64;
+            memset(idx, 0, sizeof(idx));
+            memset(mask, 0, sizeof(mask));
+            memset(valid, 0, sizeof(valid));
+            for(int j = 0; j < out_count; j++)
+            {
+                if(gather[j] == GATHER_ERASURE) continue;
+                idx[j / 64][j % 64] = gather[j] & 127;
+                mask[j / 64][gather[j] / 128] |= 1ULL << (j % 64);
+                valid[j / 64] |= 1ULL << (j % 64);
+            }
+        }
+    };
+
+    /*!
+     * \brief A permutation of one symbol, optionally with erasures inserted.
+     */
+    struct interleave_map
+    {
+        int in_count;                                   //!< Input bits per symbol
+        int out_count;                                  //!< Output bits per symbol
+        unsigned short gather[DEPUNCTURE_MAX_REGS * 64]; //!< out[j] = in[gather[j]] or an erasure
+        interleave_simd_table simd;
+
+        void init(const unsigned short * g, int in, int out)
+        {
+            in_count = in;
+            out_count = out;
+            memcpy(gather, g, out * sizeof(unsigned short));
+            simd.init(gather, in, out);
+        }
+    };
+
+    /*!
+     * \brief The maps of one coded bits per symbol.
+     *
+     * Deinterleaving followed by depuncturing is a single map per puncturing pattern: the
+     * i-th kept position of the depunctured symbol gathers the i-th deinterleaved bit.
+     */
+    struct interleave_layout
     {
-        std::vector<unsigned int> interleave_map;
-        BitInterleave(48, 1).fill(interleave_map, false);
+        interleave_map interleave;
+        interleave_map deinterleave;
+        interleave_map deinterleave_depuncture[PUNCTURE_COUNT];
+    };
+
+    template<int CBPS, int BPSC>
+    static void init_layout(interleave_layout & l)
+    {
+        l.interleave.init(interleave_table<CBPS, BPSC>::gather_interleave, CBPS, CBPS);
+        l.deinterleave.init(interleave_table<CBPS, BPSC>::gather_deinterleave, CBPS, CBPS);
+
+        // A symbol always starts a new period, cbps is a multiple of the kept bits per period
+        for(int p = 0; p < PUNCTURE_COUNT; p++)
+        {
+            int out = CBPS / __builtin_popcount(PUNCTURE_KEEP[p]) * PUNCTURE_PERIOD[p];
+            unsigned short gather[DEPUNCTURE_MAX_REGS * 64];
+            for(int j = 0, k = 0; j < out; j++)
+            {
+                if((PUNCTURE_KEEP[p] >> (j % PUNCTURE_PERIOD[p])) & 1) gather[j] = interleave_table<CBPS, BPSC>::gather_deinterleave[k++];
+                else gather[j] = GATHER_ERASURE;
+            }
+            l.deinterleave_depuncture[p].init(gather, CBPS, out);
+        }
+    }
 
+    struct interleave_layouts
+    {
+        interleave_layout bpsk, qpsk, qam16, qam64;
+
+        interleave_layouts()
+        {
+            init_layout<48, 1>(bpsk);
+            init_layout<96, 2>(qpsk);
+            init_layout<192, 4>(qam16);
+            init_layout<288, 6>(qam64);
+        }
+    };
+
+    static const interleave_layout & get_layout(const RateParams & rate_params)
+    {
+        static const interleave_layouts layouts;
+        switch(rate_params.bpsc)
+        {
+            case 2: return layouts.qpsk;
+            case 4: return layouts.qam16;
+            case 6: return layouts.qam64;
+            default: return layouts.bpsk;
+        }
+    }
+
+    static void permute_generic(const unsigned char * in, unsigned char * out, int symbols, const interleave_map & m)
+    {
+        for(int s = 0; s < symbols; s++, in += m.in_count, out += m.out_count)
+            for(int j = 0; j < m.out_count; j++)
+                out[j] = m.gather[j] == GATHER_ERASURE ? ERASURE : in[m.gather[j]];
+    }
+
+    /*!
+     *  One symbol at a time. The last register of a symbol is loaded and stored with a mask
+     *  so that nothing outside of the symbol is touched.
+     */
+    __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+    static void permute_avx512_vbmi(const unsigned char * in, unsigned char * out, int symbols, const interleave_map & m)
+    {
+        const interleave_simd_table & t = m.simd;
+        int windows = (t.in_regs + 1) / 2;
+        __mmask64 in_tail = m.in_count % 64 ? (1ULL << (m.in_count % 64)) - 1 : ~0ULL;
+        __mmask64 out_tail = m.out_count % 64 ? (1ULL << (m.out_count % 64)) - 1 : ~0ULL;
+        const __m512i erasure = _mm512_set1_epi8(ERASURE);
+
+        for(int s = 0; s < symbols; s++, in += m.in_count, out += m.out_count)
+        {
+            __m512i src[INTERLEAVE_MAX_REGS + 1];
+            for(int r = 0; r < t.in_regs - 1; r++) src[r] = _mm512_loadu_si512(in + 64 * r);
+            src[t.in_regs - 1] = _mm512_maskz_loadu_epi8(in_tail, in + 64 * (t.in_regs - 1));
+            src[t.in_regs] = _mm512_setzero_si512();
+
+            for(int r = 0; r < t.out_regs; r++)
+            {
+                __m512i idx = _mm512_loadu_si512(t.idx[r]);
+                __m512i acc = _mm512_mask_mov_epi8(erasure, t.mask[r][0], _mm512_permutex2var_epi8(src[0], idx, src[1]));
+                for(int w = 1; w < windows; w++)
+                    acc = _mm512_mask_mov_epi8(acc, t.mask[r][w], _mm512_permutex2var_epi8(src[2 * w], idx, src[2 * w + 1]));
+
+                if(r < t.out_regs - 1) _mm512_storeu_si512(out + 64 * r, acc);
+                else _mm512_mask_storeu_epi8(out + 64 * r, out_tail, acc);
+            }
+        }
+    }
+
+    static void permute(const unsigned char * in, unsigned char * out, int count, const interleave_map & m)
+    {
+        assert(count % m.in_count == 0);
+        if(cpu_features::has_avx512_vbmi()) permute_avx512_vbmi(in, out, count / m.in_count, m);
+        else permute_generic(in, out, count / m.in_count, m);
+    }
+
+    void interleaver::interleave(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params)
+    {
+        permute(in, out, count, get_layout(rate_params).interleave);
+    }
+
+    void interleaver::deinterleave(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params)
+    {
+        permute(in, out, count, get_layout(rate_params).deinterleave);
+    }
+
+    int interleaver::deinterleave_depuncture(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params)
+    {
+        const interleave_map & m = get_layout(rate_params).deinterleave_depuncture[puncturer::pattern(rate_params)];
+        permute(in, out, count, m);
+        return count / m.in_count * m.out_count;
+    }
+
+    // Interleave some data
+    std::vector<unsigned char> interleaver::interleave(const std::vector<unsigned char> & data, RateParams rate_params)
+    {
         std::vector<unsigned char> data_interleaved(data.size());
-        for(int x = 0; x < data.size(); x += interleave_map.size())
-            for(int y = 0; y < interleave_map.size(); y++)
-                data_interleaved[x + interleave_map[y]] = data[x + y];
+        interleave(data.data(), data_interleaved.data(), data.size(), rate_params);
         return data_interleaved;
     }
 
     // Deinterleave some data
-    std::vector<unsigned char> interleaver::deinterleave(std::vector<unsigned char> data)
+    std::vector<unsigned char> interleaver::deinterleave(const std::vector<unsigned char> & data, RateParams rate_params)
     {
-        std::vector<unsigned int> deinterleave_map;
-        BitInterleave(48, 1).fill(deinterleave_map, true);
-
-        std::vector<unsigned char>data_deinterleaved(data.size());
-        for(int s = 0; s < data.size(); s += deinterleave_map.size())
-            for(int t = 0; t < deinterleave_map.size(); t++)
-                data_deinterleaved[s + deinterleave_map[t]] = data[s + t];
+        std::vector<unsigned char> data_deinterleaved(data.size());
+        deinterleave(data.data(), data_deinterleaved.data(), data.size(), rate_params);
         return data_deinterleaved;
     }
 }
-
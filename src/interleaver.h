@@ -2,9 +2,10 @@
  *  \brief Header file for the Interleaver class and the BitInterleave struct.
  *
  * The interleaver class performs interleaving as described in section 17.3.5.6 of
- * the 802.11a-1999 standard. The Interleaver class contains two static functions:
- * interleave and deinterleave and thus doesn't need a constructor. However, it does
- * use the BitInterleave struct as a helper for these two functions.
+ * the 802.11a-1999 standard. The Interleaver class contains static functions:
+ * interleave and deinterleave and thus doesn't need a constructor. The permutations
+ * of every coded bits per symbol are computed at compile time, the BitInterleave
+ * struct computes the same permutation at runtime.
  *
  */
 
@@ -24,9 +25,9 @@ namespace fun
      * \brief The interleaver class
      *
      * The interleaver class performs interleaving as described in section 17.3.5.6 of
-     * the 802.11a-1999 standard. The Interleaver class contains two static functions:
-     * interleave and deinterleave and thus doesn't need a constructor. However, it does
-     * use the BitInterleave struct as a helper for these two functions.
+     * the 802.11a-1999 standard. The Interleaver class contains static functions:
+     * interleave and deinterleave and thus doesn't need a constructor. The permutation
+     * depends on the coded bits per symbol and bits per subcarrier of the rate.
      */
     class interleaver
     {
@@ -35,16 +36,52 @@ namespace fun
         /*!
          * \brief interleaves the data
          * \param data Vector of data to be interleaved
+         * \param rate_params The parameters of the PHY rate, which select the permutation
          * \return Vector of interleaved data
          */
-        static std::vector<unsigned char> interleave(std::vector<unsigned char> data);
+        static std::vector<unsigned char> interleave(const std::vector<unsigned char> & data, RateParams rate_params = RateParams(RATE_1_2_BPSK));
 
         /*!
          * \brief deinterleaves the data
          * \param data Vector of data to be deinterleaved
+         * \param rate_params The parameters of the PHY rate, which select the permutation
          * \return Vector of deinterleaved data
          */
-        static std::vector<unsigned char> deinterleave(std::vector<unsigned char> data);
+        static std::vector<unsigned char> deinterleave(const std::vector<unsigned char> & data, RateParams rate_params = RateParams(RATE_1_2_BPSK));
+
+        /*!
+         * \brief interleaves the data into a caller provided buffer
+         * \param in The data to be interleaved
+         * \param out The interleaved data, must not overlap in
+         * \param count Number of bits (bytes), a multiple of rate_params.cbps
+         * \param rate_params The parameters of the PHY rate, which select the permutation
+         */
+        static void interleave(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params);
+
+        /*!
+         * \brief deinterleaves the data into a caller provided buffer
+         * \param in The data to be deinterleaved
+         * \param out The deinterleaved data, must not overlap in
+         * \param count Number of bits (bytes), a multiple of rate_params.cbps
+         * \param rate_params The parameters of the PHY rate, which select the permutation
+         */
+        static void deinterleave(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params);
+
+        /*!
+         * \brief deinterleaves and depunctures the data in a single pass
+         * \param in The demodulated soft bits, still interleaved and punctured
+         * \param out The depunctured soft bits with erasures (127) in the puncture holes, ready
+         *        for viterbi::conv_decode. Needs room for count / rate_params.rel_rate bits and
+         *        must not overlap in.
+         * \param count Number of input bits (bytes), a multiple of rate_params.cbps
+         * \param rate_params The parameters of the PHY rate, which select the permutation and
+         *        the puncturing pattern
+         * \return Number of bits written to out
+         *
+         * The output is identical to puncturer::depuncture(interleaver::deinterleave(data)).
+         * Each OFDM symbol is depunctured on its own, so this also works symbol by symbol.
+         */
+        static int deinterleave_depuncture(const unsigned char * in, unsigned char * out, int count, const RateParams & rate_params);
 
     };
 
@@ -10,14 +10,121 @@
  *  -64 QAM
  */
 
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
 #include <cstring>
 
 #include "modulator.h"
 #include "qam.h"
+#include "symbol_mapper.h"
+#include "cpu_features.h"
 
 namespace fun
 {
 
+    /*!
+     * \brief The constellation points of a modulation, indexed by the bits of a subcarrier
+     *  (the first bit is the most significant).
+     *
+     * The points are computed with QAM<N>::encode, BPSK only uses the real axis and the other
+     * modulations put the first half of the bits on the real axis and the rest on the imaginary axis.
+     */
+    template<int BPSC>
+    struct constellation
+    {
+        std::complex<double> points[1 << BPSC];
+
+        constellation()
+        {
+            for(int i = 0; i < (1 << BPSC); i++)
+            {
+                char bits[BPSC];
+                for(int b = 0; b < BPSC; b++) bits[b] = (i >> (BPSC - 1 - b)) & 1;
+
+                double iq[2] = { 0, 0 };
+                if(BPSC == 1)
+                {
+                    QAM<1> bpsk(1.0);
+                    bpsk.encode(&bits[0], &iq[0]);
+                }
+                else
+                {
+                    QAM<(BPSC + 1) / 2> qam(0.5);
+                    qam.encode(&bits[0], &iq[0]);
+                    qam.encode(&bits[BPSC / 2], &iq[1]);
+                }
+                points[i] = std::complex<double>(iq[0], iq[1]);
+            }
+        }
+    };
+
+    template<int BPSC>
+    static const constellation<BPSC> & get_constellation()
+    {
+        static const constellation<BPSC> table;
+        return table;
+    }
+
+    // Table index of the BPSC bits (one per byte) of a subcarrier, unrolled for each modulation
+    template<int BPSC>
+    static inline int constellation_index(const unsigned char * bits)
+    {
+        int index = 0;
+        for(int b = 0; b < BPSC; b++) index = (index << 1) | (bits[b] & 1);
+        return index;
+    }
+
+    /*
+     * The mappers are templated on the bits per subcarrier and on whether the points go to
+     * consecutive samples or to the data subcarriers of 64 subcarrier symbols. A scale is
+     * applied to the (at most 64) constellation points once, not to every sample.
+     */
+    template<int BPSC, bool SUBCARRIERS>
+    static void modulate_bits(const unsigned char * data, std::complex<double> * samples, int count, double scale)
+    {
+        const std::complex<double> * points = get_constellation<BPSC>().points;
+        std::complex<double> scaled[1 << BPSC];
+        if(scale != 1.0)
+        {
+            for(int i = 0; i < (1 << BPSC); i++) scaled[i] = points[i] * scale;
+            points = scaled;
+        }
+        int point_count = count / BPSC;
+        if(SUBCARRIERS)
+        {
+            assert(point_count % 48 == 0);
+            for(int x = 0; x < point_count; x += 48, samples += 64, data += 48 * BPSC)
+                for(int s = 0; s < 48; s++)
+                    samples[symbol_mapper::DATA_SUBCARRIERS[s]] = points[constellation_index<BPSC>(&data[s * BPSC])];
+        }
+        else
+        {
+            for(int x = 0; x < point_count; x++)
+                samples[x] = points[constellation_index<BPSC>(&data[x * BPSC])];
+        }
+    }
+
+    // Index of a modulation in the kernel tables, BPSK, QPSK, QAM16, QAM64
+    static inline int modulation_index(Rate rate)
+    {
+        return RateParams(rate).bpsc / 2;
+    }
+
+    modulator::modulate_kernel modulator::get_modulate_kernel(Rate rate)
+    {
+        static const modulate_kernel kernels[4] =
+            { &modulate_bits<1, false>, &modulate_bits<2, false>, &modulate_bits<4, false>, &modulate_bits<6, false> };
+        return kernels[modulation_index(rate)];
+    }
+
+    modulator::modulate_kernel modulator::get_subcarrier_kernel(Rate rate)
+    {
+        static const modulate_kernel kernels[4] =
+            { &modulate_bits<1, true>, &modulate_bits<2, true>, &modulate_bits<4, true>, &modulate_bits<6, true> };
+        return kernels[modulation_index(rate)];
+    }
+
     /*!
      *  Modulates the input data vector using one of the following modulations
      *  based on the given rate:
@@ -26,75 +133,158 @@ namespace fun
      *  -16 QAM
      *  -64 QAM
      */
-    std::vector<std::complex<double> > modulator::modulate(std::vector<unsigned char> data, Rate rate)
+    void modulator::modulate(const unsigned char * data, std::complex<double> * samples, int count, Rate rate)
     {
-        // Modualate the data
-        int modulated_sample_count = data.size();
-        std::vector<double> data_mod_buffer;
-        switch(rate)
+        get_modulate_kernel(rate)(data, samples, count, 1.0);
+    }
+
+    void modulator::modulate_subcarriers(const unsigned char * data, std::complex<double> * symbols, int count, Rate rate, double scale)
+    {
+        get_subcarrier_kernel(rate)(data, symbols, count, scale);
+    }
+
+    /*!
+     *  Modulates the input data vector using one of the following modulations
+     *  based on the given rate:
+     *  -BPSK
+     *  -QPSK
+     *  -16 QAM
+     *  -64 QAM
+     */
+    std::vector<std::complex<double> > modulator::modulate(const std::vector<unsigned char> & data, Rate rate)
+    {
+        std::vector<std::complex<double> > modulated_data(data.size() / RateParams(rate).bpsc);
+        modulate(data.data(), modulated_data.data(), data.size(), rate);
+        return modulated_data;
+    }
+
+    /*
+     * Demapper body shared by all the variants below. It is force-inlined into each of them so
+     * that every copy is vectorized for that variant's instruction set.
+     */
+    template<int BPSC>
+    static inline __attribute__((always_inline)) void demodulate_body(const std::complex<double> * data, unsigned char * data_demodulated, int count)
+    {
+        if(BPSC == 1)
+        {
+            QAM<1> bpsk(1.0);
+            for(int s = 0; s < count; s++)
+                bpsk.decode(data[s].real(), &data_demodulated[s]);
+        }
+        else
         {
-            // BPSK
-            case RATE_1_2_BPSK: case RATE_2_3_BPSK: case RATE_3_4_BPSK:
+            QAM<(BPSC + 1) / 2> qam(0.5);
+            for(int s = 0; s < count; s++)
             {
-                QAM<1> bpsk(1.0);
-                data_mod_buffer = std::vector<double>(modulated_sample_count * 2, 0);
-                for(int x = 0; x < modulated_sample_count; x++)
-                {
-                    bpsk.encode((const char *)&data[x], &data_mod_buffer[x*2]);
-                }
-
-                break;
+                qam.decode(data[s].real(), &data_demodulated[s*BPSC]);
+                qam.decode(data[s].imag(), &data_demodulated[s*BPSC+BPSC/2]);
             }
+        }
+    }
 
-            // QPSK
-            case RATE_1_2_QPSK: case RATE_2_3_QPSK: case RATE_3_4_QPSK:
-            {
-                QAM<1> qpsk(0.5);
-                modulated_sample_count /= 2;
-                data_mod_buffer = std::vector<double>(modulated_sample_count * 2, 0);
-                for(int x = 0; x < modulated_sample_count; x++)
-                {
-                    qpsk.encode((const char *)&data[x*2], &data_mod_buffer[x*2]);
-                    qpsk.encode((const char *)&data[x*2+1], &data_mod_buffer[x*2+1]);
-                }
+    template<int BPSC>
+    static void demodulate_generic(const std::complex<double> * data, unsigned char * data_demodulated, int count)
+    {
+        demodulate_body<BPSC>(data, data_demodulated, count);
+    }
 
-                break;
-            }
+    template<int BPSC>
+    __attribute__((target("avx2")))
+    static void demodulate_avx2(const std::complex<double> * data, unsigned char * data_demodulated, int count)
+    {
+        demodulate_body<BPSC>(data, data_demodulated, count);
+    }
 
-            // QAM16
-            case RATE_1_2_QAM16: case RATE_2_3_QAM16: case RATE_3_4_QAM16:
-            {
-                QAM<2> qam16(0.5);
-                modulated_sample_count /= 4;
-                data_mod_buffer = std::vector<double>(modulated_sample_count * 2, 0);
-                for(int x = 0; x < modulated_sample_count; x++)
-                {
-                    qam16.encode((const char *)&data[x*4], &data_mod_buffer[x*2]);
-                    qam16.encode((const char *)&data[x*4+2], &data_mod_buffer[x*2+1]);
-                }
+    template<int BPSC>
+    __attribute__((target("avx512f,avx512bw")))
+    static void demodulate_avx512(const std::complex<double> * data, unsigned char * data_demodulated, int count)
+    {
+        demodulate_body<BPSC>(data, data_demodulated, count);
+    }
 
-                break;
-            }
+    /*
+     * The soft bits of a subcarrier are the max-log LLRs of QAM<N>::decode scaled by
+     * w = min(1, SNR * max(1 / mean SNR, a^2 / DEMAP_FULL_SCALE_SNR)), where SNR is the subcarrier's
+     * |H|^2 / noise power, the mean is taken over the samples of the call (one OFDM symbol) and a
+     * is the distance from a constellation point to the nearest decision boundary (1 for BPSK,
+     * 1/sqrt(42) for QAM64). Subcarriers at least as strong as the average, or reliable enough on
+     * their own, keep the full 8 bit range. The soft bits of weaker ones are scaled down in
+     * proportion to their SNR, which keeps the confidences of a symbol in the ratio of their LLRs
+     * without squeezing a flat channel into the few levels the decoder's metrics resolve.
+     */
+    template<int BPSC>
+    static inline __attribute__((always_inline)) void demodulate_csi_body(const std::complex<double> * data, const float * csi, unsigned char * data_demodulated, int count)
+    {
+        const double a2 = BPSC == 1 ? 1.0 : 3.0 / (2.0 * ((1 << BPSC) - 1));
+        double mean = 0;
+        for(int s = 0; s < count; s++) mean += csi[s];
+        mean /= count;
+        const double k = mean > 0 ? std::max(1.0 / mean, a2 / DEMAP_FULL_SCALE_SNR) : DBL_MAX;
 
-            // QAM64
-            case RATE_2_3_QAM64: case RATE_3_4_QAM64:
+        if(BPSC == 1)
+        {
+            QAM<1> bpsk(1.0);
+            for(int s = 0; s < count; s++)
             {
-                QAM<3> qam64(0.5);
-                modulated_sample_count /= 6;
-                data_mod_buffer = std::vector<double>(modulated_sample_count * 2, 0);
-                for(int x = 0; x < modulated_sample_count; x++)
-                {
-                    qam64.encode((const char *)&data[x*6], &data_mod_buffer[x*2]);
-                    qam64.encode((const char *)&data[x*6+3], &data_mod_buffer[x*2+1]);
-                }
-
-                break;
+                double w = std::min(csi[s] * k, 1.0);
+                bpsk.decode(data[s].real(), &data_demodulated[s], w);
+            }
+        }
+        else
+        {
+            QAM<(BPSC + 1) / 2> qam(0.5);
+            for(int s = 0; s < count; s++)
+            {
+                double w = std::min(csi[s] * k, 1.0);
+                qam.decode(data[s].real(), &data_demodulated[s*BPSC], w);
+                qam.decode(data[s].imag(), &data_demodulated[s*BPSC+BPSC/2], w);
             }
         }
+    }
 
-        std::vector<std::complex<double> > modulated_data(data_mod_buffer.size() / 2);
-        memcpy(&modulated_data[0], &data_mod_buffer[0], modulated_data.size() * sizeof(std::complex<double>));
-        return modulated_data;
+    template<int BPSC>
+    static void demodulate_csi_generic(const std::complex<double> * data, const float * csi, unsigned char * data_demodulated, int count)
+    {
+        demodulate_csi_body<BPSC>(data, csi, data_demodulated, count);
+    }
+
+    template<int BPSC>
+    __attribute__((target("avx2")))
+    static void demodulate_csi_avx2(const std::complex<double> * data, const float * csi, unsigned char * data_demodulated, int count)
+    {
+        demodulate_csi_body<BPSC>(data, csi, data_demodulated, count);
+    }
+
+    template<int BPSC>
+    __attribute__((target("avx512f,avx512bw")))
+    static void demodulate_csi_avx512(const std::complex<double> * data, const float * csi, unsigned char * data_demodulated, int count)
+    {
+        demodulate_csi_body<BPSC>(data, csi, data_demodulated, count);
+    }
+
+    /*!
+     *  The demapper implementation is picked by cpu_features.
+     */
+    modulator::demodulate_kernel modulator::get_demodulate_kernel(Rate rate)
+    {
+        #define DEMODULATE_KERNELS(BPSC) { &demodulate_generic<BPSC>, nullptr, &demodulate_avx2<BPSC>, &demodulate_avx512<BPSC> }
+        static const demodulate_kernel kernels[4][ARCH_COUNT] =
+        {
+            DEMODULATE_KERNELS(1), DEMODULATE_KERNELS(2), DEMODULATE_KERNELS(4), DEMODULATE_KERNELS(6)
+        };
+        #undef DEMODULATE_KERNELS
+        return cpu_features::select(kernels[modulation_index(rate)]);
+    }
+
+    modulator::demodulate_csi_kernel modulator::get_demodulate_csi_kernel(Rate rate)
+    {
+        #define DEMODULATE_CSI_KERNELS(BPSC) { &demodulate_csi_generic<BPSC>, nullptr, &demodulate_csi_avx2<BPSC>, &demodulate_csi_avx512<BPSC> }
+        static const demodulate_csi_kernel kernels[4][ARCH_COUNT] =
+        {
+            DEMODULATE_CSI_KERNELS(1), DEMODULATE_CSI_KERNELS(2), DEMODULATE_CSI_KERNELS(4), DEMODULATE_CSI_KERNELS(6)
+        };
+        #undef DEMODULATE_CSI_KERNELS
+        return cpu_features::select(kernels[modulation_index(rate)]);
     }
 
     /*!
@@ -105,62 +295,25 @@ namespace fun
     *  -16 QAM
     *  -64 QAM
     */
-    std::vector<unsigned char> modulator::demodulate(std::vector<std::complex<double> > data, Rate rate)
+    void modulator::demodulate(const std::complex<double> * samples, unsigned char * data, int count, Rate rate)
+    {
+        get_demodulate_kernel(rate)(samples, data, count);
+    }
+
+    void modulator::demodulate(const std::complex<double> * samples, const float * csi, unsigned char * data, int count, Rate rate)
+    {
+        get_demodulate_csi_kernel(rate)(samples, csi, data, count);
+    }
+
+    std::vector<unsigned char> modulator::demodulate(const std::vector<std::complex<double> > & data, Rate rate)
     {
         RateParams rp = RateParams(rate);
 
         // Demodulate the data
         int coded_bit_count = data.size();
         std::vector<unsigned char>data_demodulated(coded_bit_count * rp.bpsc, 0);
-        switch(rate)
-        {
-            // BPSK
-            case RATE_1_2_BPSK: case RATE_2_3_BPSK: case RATE_3_4_BPSK:
-            {
-                QAM<1> bpsk(1.0);
-                for(int s = 0; s < coded_bit_count; s++)
-                    bpsk.decode(data[s].real(), &data_demodulated[s]);
-                break;
-            }
-
-            // QPSK
-            case RATE_1_2_QPSK: case RATE_2_3_QPSK: case RATE_3_4_QPSK:
-            {
-                QAM<1> qpsk(0.5);
-                for(int s = 0; s < coded_bit_count; s++)
-                {
-                    qpsk.decode(data[s].real(), &data_demodulated[s*2]);
-                    qpsk.decode(data[s].imag(), &data_demodulated[s*2+1]);
-                }
-                break;
-            }
-
-            // QAM16
-            case RATE_1_2_QAM16: case RATE_2_3_QAM16: case RATE_3_4_QAM16:
-            {
-                QAM<2> qam16(0.5);
-                for(int s = 0; s < coded_bit_count; s++)
-                {
-                    qam16.decode(data[s].real(), &data_demodulated[s*4]);
-                    qam16.decode(data[s].imag(), &data_demodulated[s*4+2]);
-                }
-                break;
-            }
-
-            // QAM64
-            case RATE_2_3_QAM64: case RATE_3_4_QAM64:
-            {
-                QAM<3> qam64(0.5);
-                for(int s = 0; s < coded_bit_count; s++)
-                {
-                    qam64.decode(data[s].real(), &data_demodulated[s*6]);
-                    qam64.decode(data[s].imag(), &data_demodulated[s*6+3]);
-                }
-                break;
-            }
-        }
+        demodulate(data.data(), data_demodulated.data(), coded_bit_count, rate);
 
         return data_demodulated;
     }
 }
-
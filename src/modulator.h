@@ -15,9 +15,16 @@
 #define MODULATOR_H
 
 #include <complex>
+#include <vector>
 
 #include "rates.h"
 
+/*!
+ * \brief SNR (times the squared distance to the nearest decision boundary) at which the soft bits
+ *  of a subcarrier reach full confidence in the channel state weighted demodulator.
+ */
+#define DEMAP_FULL_SCALE_SNR 8.0f
+
 namespace fun
 {
 
@@ -36,13 +43,69 @@ namespace fun
     {
     public:
 
+        /*!
+         * \brief A modulator specialized for one modulation, see modulate(const unsigned char *, std::complex<double> *, int, Rate).
+         */
+        typedef void (*modulate_kernel)(const unsigned char * data, std::complex<double> * samples, int count, double scale);
+
+        /*!
+         * \brief A demodulator specialized for one modulation, see demodulate(const std::complex<double> *, unsigned char *, int, Rate).
+         */
+        typedef void (*demodulate_kernel)(const std::complex<double> * samples, unsigned char * data, int count);
+
+        /*!
+         * \brief Gets the modulator for a rate, so that the rate is only looked up once per frame.
+         */
+        static modulate_kernel get_modulate_kernel(Rate rate);
+
+        /*!
+         * \brief Gets the subcarrier mapper for a rate, see modulate_subcarriers().
+         */
+        static modulate_kernel get_subcarrier_kernel(Rate rate);
+
+        /*!
+         * \brief Gets the demodulator for a rate and the active cpu_features level, so that both are
+         *  only looked up once per frame.
+         */
+        static demodulate_kernel get_demodulate_kernel(Rate rate);
+
+        /*!
+         * \brief A channel state weighted demodulator, see demodulate(const std::complex<double> *, const float *, unsigned char *, int, Rate).
+         */
+        typedef void (*demodulate_csi_kernel)(const std::complex<double> * samples, const float * csi, unsigned char * data, int count);
+
+        /*!
+         * \brief Gets the channel state weighted demodulator for a rate and the active cpu_features level.
+         */
+        static demodulate_csi_kernel get_demodulate_csi_kernel(Rate rate);
+
         /*!
          * \brief Modulates the data.
          * \param data Vector of data in bytes to be modulated.
          * \param rate PHY transmission rate from which the type of modulation is extracted.
          * \return Vector of modulated data as complex doubles.
          */
-        static std::vector<std::complex<double> > modulate(std::vector<unsigned char> data, Rate rate);
+        static std::vector<std::complex<double> > modulate(const std::vector<unsigned char> & data, Rate rate);
+
+        /*!
+         * \brief Modulates the data into a caller provided buffer.
+         * \param data The bits to be modulated, one per byte.
+         * \param samples The modulated samples, needs room for count / bpsc samples.
+         * \param count Number of bits, a multiple of the bits per subcarrier of the rate.
+         * \param rate PHY transmission rate from which the type of modulation is extracted.
+         */
+        static void modulate(const unsigned char * data, std::complex<double> * samples, int count, Rate rate);
+
+        /*!
+         * \brief Modulates the data straight onto the data subcarriers of OFDM symbols.
+         * \param data The bits to be modulated, one per byte.
+         * \param symbols The symbols, 64 subcarriers each as in symbol_mapper::map. Only the
+         *  symbol_mapper::DATA_SUBCARRIERS are written, see symbol_mapper::map_pilots for the rest.
+         * \param count Number of bits, a multiple of 48 times the bits per subcarrier of the rate.
+         * \param rate PHY transmission rate from which the type of modulation is extracted.
+         * \param scale [Optional] Factor for the constellation points, e.g. to fold in the IFFT scaling.
+         */
+        static void modulate_subcarriers(const unsigned char * data, std::complex<double> * symbols, int count, Rate rate, double scale = 1.0);
 
         /*!
          * \brief Demodulates the data.
@@ -50,7 +113,30 @@ namespace fun
          * \param rate PHY transmission frate from which the type of modulation is extracted.
          * \return Vector of demodulated data in bytes.
          */
-        static std::vector<unsigned char> demodulate(std::vector<std::complex<double> > data, Rate rate);
+        static std::vector<unsigned char> demodulate(const std::vector<std::complex<double> > & data, Rate rate);
+
+        /*!
+         * \brief Demodulates the data into a caller provided buffer.
+         * \param samples The samples to be demodulated.
+         * \param data The soft bits, needs room for count * bpsc bytes.
+         * \param count Number of samples.
+         * \param rate PHY transmission rate from which the type of modulation is extracted.
+         */
+        static void demodulate(const std::complex<double> * samples, unsigned char * data, int count, Rate rate);
+
+        /*!
+         * \brief Demodulates equalized samples into soft bits weighted by the channel state.
+         * \param samples The equalized samples to be demodulated.
+         * \param csi The SNR (|H|^2 / noise power) of the subcarrier of each sample, see tagged_csi_vector.
+         * \param data The soft bits, needs room for count * bpsc bytes.
+         * \param count Number of samples.
+         * \param rate PHY transmission rate from which the type of modulation is extracted.
+         *
+         * Samples from faded subcarriers get soft bits closer to the erasure value, samples from
+         * subcarriers whose SNR is at least #DEMAP_FULL_SCALE_SNR per decision distance get the
+         * same soft bits as the unweighted demodulate().
+         */
+        static void demodulate(const std::complex<double> * samples, const float * csi, unsigned char * data, int count, Rate rate);
     };
 }
 
@@ -0,0 +1,157 @@
+/*! \file mpmc_queue.h
+ *  \brief Template for a bounded multi-producer multi-consumer queue.
+ *
+ *  This class passes items between threads through a fixed size ring. Pushing and
+ *  popping an item never takes a lock: every slot carries a sequence number that tells
+ *  producers and consumers whose turn it is, and the head and tail are claimed with an
+ *  atomic increment. Two counting semaphores keep track of the free and the used slots so
+ *  that the blocking push() and pop() can sleep while the queue is full or empty.
+ */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <semaphore.h>
+
+namespace fun
+{
+    /*!
+     * \brief The mpmc_queue template.
+     *
+     * Any number of threads may push and pop at the same time. The items are handed out in
+     * the order their push() claimed a slot. T should be cheap to copy, e.g. a pointer.
+     */
+    template<typename T>
+    class mpmc_queue
+    {
+    public:
+
+        /*!
+         * \brief Constructor for mpmc_queue
+         * \param capacity Maximum number of items in the queue.
+         */
+        explicit mpmc_queue(int capacity) :
+            m_head(0),
+            m_tail(0)
+        {
+            int size = 1;
+            while(size < capacity) size <<= 1;
+            m_mask = size - 1;
+            m_cells = new cell[size];
+            for(int x = 0; x < size; x++) m_cells[x].sequence.store(x, std::memory_order_relaxed);
+
+            sem_init(&m_free, 0, capacity);
+            sem_init(&m_used, 0, 0);
+        }
+
+        ~mpmc_queue()
+        {
+            sem_destroy(&m_free);
+            sem_destroy(&m_used);
+            delete [] m_cells;
+        }
+
+        /*!
+         * \brief Adds an item, blocking while the queue is full.
+         */
+        void push(const T & item)
+        {
+            while(sem_wait(&m_free) != 0 && errno == EINTR);
+            enqueue(item);
+            sem_post(&m_used);
+        }
+
+        /*!
+         * \brief Adds an item if the queue isn't full.
+         * \return Whether the item was added.
+         */
+        bool try_push(const T & item)
+        {
+            if(sem_trywait(&m_free) != 0) return false;
+            enqueue(item);
+            sem_post(&m_used);
+            return true;
+        }
+
+        /*!
+         * \brief Removes the oldest item, blocking while the queue is empty.
+         */
+        T pop()
+        {
+            while(sem_wait(&m_used) != 0 && errno == EINTR);
+            T item = dequeue();
+            sem_post(&m_free);
+            return item;
+        }
+
+        /*!
+         * \brief Removes the oldest item if there is one.
+         * \param item Output for the item.
+         * \return Whether there was an item.
+         */
+        bool try_pop(T & item)
+        {
+            if(sem_trywait(&m_used) != 0) return false;
+            item = dequeue();
+            sem_post(&m_free);
+            return true;
+        }
+
+    private:
+
+        /*!
+         * \brief A slot of the ring.
+         *
+         * The sequence of the slot for position p is p while the slot is free for that
+         * position and p + 1 once the item for position p is in it.
+         */
+        struct cell
+        {
+            std::atomic<size_t> sequence; //!< Position the slot is waiting for
+            T item;                       //!< The item
+        };
+
+        mpmc_queue(const mpmc_queue &);             //!< Not copyable
+        mpmc_queue & operator=(const mpmc_queue &); //!< Not copyable
+
+        /*
+         * The semaphores guarantee a free slot, but the consumer of the previous lap may not
+         * have released it yet, so the producer yields until it has.
+         */
+        void enqueue(const T & item)
+        {
+            size_t position = m_tail.fetch_add(1, std::memory_order_relaxed);
+            cell & c = m_cells[position & m_mask];
+            while(c.sequence.load(std::memory_order_acquire) != position) std::this_thread::yield();
+            c.item = item;
+            c.sequence.store(position + 1, std::memory_order_release);
+        }
+
+        T dequeue()
+        {
+            size_t position = m_head.fetch_add(1, std::memory_order_relaxed);
+            cell & c = m_cells[position & m_mask];
+            while(c.sequence.load(std::memory_order_acquire) != position + 1) std::this_thread::yield();
+            T item = c.item;
+            c.sequence.store(position + m_mask + 1, std::memory_order_release);
+            return item;
+        }
+
+        cell * m_cells; //!< The ring, its size is a power of two
+
+        size_t m_mask; //!< Size of the ring minus one
+
+        alignas(64) std::atomic<size_t> m_head; //!< Position of the next item to pop
+
+        alignas(64) std::atomic<size_t> m_tail; //!< Position of the next item to push
+
+        sem_t m_free; //!< Number of free slots
+
+        sem_t m_used; //!< Number of items
+    };
+}
+
+#endif // MPMC_QUEUE_H
@@ -30,7 +30,12 @@ namespace fun
       }
       Parity_initialized=1;
     }
-}
-
-
 
+    /* Build the table while the program loads rather than on first use, so that
+     * threads encoding headers at the same time don't race to initialize it.
+     * The check in parityb() still covers callers that run before this.
+     */
+    static struct partab_loader {
+      partab_loader(){ if(!Parity_initialized) partab_init(); }
+    } Partab_loader;
+}
@@ -0,0 +1,145 @@
+/*! \file payload_pool.cpp
+ *  \brief C++ file for the payload_buffer and payload_pool classes.
+ *
+ *  Decoded payloads are handed to the receiver callback in reference counted buffers
+ *  that are recycled through a pool once the last reference is released.
+ */
+
+#include <cstring>
+#include <mutex>
+
+#include "payload_pool.h"
+
+namespace fun
+{
+    /*!
+     * \brief The free list. The lock is only held to push or pop a pointer, the
+     *  decoder and the consumer rarely touch it at the same time.
+     */
+    struct payload_free_list
+    {
+        std::mutex lock;
+        std::vector<payload_block *> blocks;
+
+        payload_free_list()
+        {
+            blocks.reserve(PAYLOAD_POOL_MAX_FREE);
+        }
+
+        ~payload_free_list()
+        {
+            for(size_t b = 0; b < blocks.size(); b++) delete blocks[b];
+        }
+    };
+
+    static payload_free_list & get_free_list()
+    {
+        static payload_free_list free_list;
+        return free_list;
+    }
+
+    payload_buffer::payload_buffer() :
+        m_block(NULL)
+    {
+    }
+
+    payload_buffer::payload_buffer(const payload_buffer & other) :
+        m_block(other.m_block)
+    {
+        if(m_block) m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    payload_buffer::payload_buffer(payload_buffer && other) :
+        m_block(other.m_block)
+    {
+        other.m_block = NULL;
+    }
+
+    payload_buffer::~payload_buffer()
+    {
+        release();
+    }
+
+    payload_buffer & payload_buffer::operator=(const payload_buffer & other)
+    {
+        if(other.m_block) other.m_block->refs.fetch_add(1, std::memory_order_relaxed);
+        release();
+        m_block = other.m_block;
+        return *this;
+    }
+
+    payload_buffer & payload_buffer::operator=(payload_buffer && other)
+    {
+        if(this != &other)
+        {
+            release();
+            m_block = other.m_block;
+            other.m_block = NULL;
+        }
+        return *this;
+    }
+
+    /*!
+     * The last handle returns the storage to the pool. The acquire/release ordering makes
+     * the other handles' reads of the bytes happen before the buffer is reused.
+     */
+    void payload_buffer::release()
+    {
+        if(m_block && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            payload_pool::recycle(m_block);
+        }
+        m_block = NULL;
+    }
+
+    /*!
+     * Reuses a released buffer if there is one. Its vector only allocates if the new
+     * payload is bigger than any payload it held before.
+     */
+    payload_buffer payload_pool::acquire(size_t size)
+    {
+        payload_free_list & free_list = get_free_list();
+        payload_block * b = NULL;
+        {
+            std::lock_guard<std::mutex> guard(free_list.lock);
+            if(!free_list.blocks.empty())
+            {
+                b = free_list.blocks.back();
+                free_list.blocks.pop_back();
+            }
+        }
+
+        if(b == NULL) b = new payload_block();
+        b->refs.store(1, std::memory_order_relaxed);
+        b->bytes.resize(size);
+        return payload_buffer(b);
+    }
+
+    payload_buffer payload_pool::acquire(const unsigned char * data, size_t size)
+    {
+        payload_buffer buffer = acquire(size);
+        if(size) memcpy(buffer.data(), data, size);
+        return buffer;
+    }
+
+    size_t payload_pool::free_count()
+    {
+        payload_free_list & free_list = get_free_list();
+        std::lock_guard<std::mutex> guard(free_list.lock);
+        return free_list.blocks.size();
+    }
+
+    void payload_pool::recycle(payload_block * b)
+    {
+        payload_free_list & free_list = get_free_list();
+        {
+            std::lock_guard<std::mutex> guard(free_list.lock);
+            if(free_list.blocks.size() < PAYLOAD_POOL_MAX_FREE)
+            {
+                free_list.blocks.push_back(b);
+                return;
+            }
+        }
+        delete b;
+    }
+}
@@ -0,0 +1,115 @@
+/*! \file payload_pool.h
+ *  \brief Header file for the payload_buffer and payload_pool classes.
+ *
+ *  Decoded payloads (MPDUs) are handed from the frame decoder to the receiver callback in
+ *  reference counted buffers. Copying a payload_buffer only copies a handle, and once the
+ *  last handle is gone the buffer goes back to the payload_pool to be reused by a later
+ *  frame, so steady state reception neither copies nor allocates payloads.
+ */
+
+#ifndef PAYLOAD_POOL_H
+#define PAYLOAD_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#define PAYLOAD_POOL_MAX_FREE 256 //!< Most released buffers the pool keeps around for reuse
+
+namespace fun
+{
+    /*!
+     * \brief The storage behind a payload_buffer. The vector keeps its capacity while pooled.
+     */
+    struct payload_block
+    {
+        std::atomic<int> refs;             //!< Number of handles
+        std::vector<unsigned char> bytes;  //!< The payload
+    };
+
+    /*!
+     * \brief The payload_buffer class
+     *
+     *  A reference counted handle to the bytes of one decoded payload. Handles are cheap to copy
+     *  and can be released from any thread. The bytes are shared between all copies of a handle
+     *  so they should be treated as read only once the buffer has been handed out.
+     */
+    class payload_buffer
+    {
+    public:
+
+        payload_buffer(); //!< Constructs an empty handle
+
+        payload_buffer(const payload_buffer & other); //!< Shares other's buffer
+
+        payload_buffer(payload_buffer && other);      //!< Takes over other's buffer
+
+        ~payload_buffer(); //!< Releases the buffer
+
+        payload_buffer & operator=(const payload_buffer & other);
+
+        payload_buffer & operator=(payload_buffer && other);
+
+        const unsigned char * data() const { return m_block ? m_block->bytes.data() : NULL; } //!< Get the bytes
+        unsigned char * data() { return m_block ? m_block->bytes.data() : NULL; }             //!< Get the bytes
+        size_t size() const { return m_block ? m_block->bytes.size() : 0; }                   //!< Get the number of bytes
+        bool empty() const { return size() == 0; }                                             //!< Whether there are no bytes
+
+        const unsigned char * begin() const { return data(); }          //!< Iterator to the first byte
+        const unsigned char * end() const { return data() + size(); }   //!< Iterator past the last byte
+        unsigned char operator[](size_t i) const { return data()[i]; }  //!< Get a byte
+
+        /*!
+         * \brief Gets the number of handles sharing this buffer (0 for an empty handle).
+         */
+        int use_count() const { return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0; }
+
+    private:
+
+        friend class payload_pool;
+
+        explicit payload_buffer(payload_block * b) : m_block(b) {}
+
+        void release(); //!< Drops this handle's reference
+
+        payload_block * m_block; //!< The shared storage or NULL
+    };
+
+    /*!
+     * \brief The payload_pool class
+     *
+     *  Recycles the storage of released payload_buffers. The class only contains static
+     *  functions and thus doesn't need a constructor. The free list is shared by all threads:
+     *  the frame decoder takes buffers on its thread and the consumer may release them on any
+     *  other.
+     */
+    class payload_pool
+    {
+    public:
+
+        /*!
+         * \brief Gets a buffer of a given size.
+         * \param size Number of bytes, the contents are unspecified.
+         * \return A handle that is the only reference to the buffer.
+         */
+        static payload_buffer acquire(size_t size);
+
+        /*!
+         * \brief Gets a buffer holding a copy of some bytes.
+         */
+        static payload_buffer acquire(const unsigned char * data, size_t size);
+
+        /*!
+         * \brief Gets the number of released buffers waiting to be reused.
+         */
+        static size_t free_count();
+
+    private:
+
+        friend class payload_buffer;
+
+        static void recycle(payload_block * b); //!< Returns storage to the free list
+    };
+}
+
+#endif // PAYLOAD_POOL_H
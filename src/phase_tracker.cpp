@@ -96,6 +96,7 @@ namespace fun
             {
                 int index = DATA_SUBCARRIERS[s];
                 output_buffer[i].samples[s] = input_buffer[i].samples[index] * std::complex<double>(std::cos(-angle), std::sin(-angle));
+                output_buffer[i].csi[s] = input_buffer[i].csi[index];
             }
 
             output_buffer[i].tag = input_buffer[i].tag;
@@ -21,15 +21,15 @@ namespace fun
     /*!
      * \brief The phase_tracker block.
      *
-     * Inputs tagged_vector<64> from channel_est block.
-     * Outputs tagged_vector <48> to frame_decoder block.
+     * Inputs tagged_csi_vector<64> from channel_est block.
+     * Outputs tagged_csi_vector<48> to frame_decoder block.
      *
      *  The phase tracker block is in charge of tracking and correcting
      *  phase rotation accross symbols in a frame using the 4 pilot subcarriers.
      *  It also removes the pilot and null subcarriers passing on only the data
      *  subcarriers after any necessary frequency corrections have been made.
      */
-    class phase_tracker : public fun::block<tagged_vector<64>, tagged_vector<48> >
+    class phase_tracker : public fun::block<tagged_csi_vector<64>, tagged_csi_vector<48> >
     {
     public:
 
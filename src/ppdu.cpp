@@ -8,7 +8,6 @@
  */
 
 #include <arpa/inet.h>
-#include <boost/crc.hpp>
 #include <iostream>
 
 #include "ppdu.h"
@@ -17,16 +16,24 @@
 #include "interleaver.h"
 #include "puncturer.h"
 #include "modulator.h"
+#include "scrambler.h"
+#include "frame_arena.h"
+#include "signal_decoder.h"
 
 namespace fun
 {
+    /*!
+     * Viterbi decoder used by the decode functions that don't get one passed in.
+     * There is one per thread so that its decision memory is reused from frame to frame.
+     */
+    static thread_local viterbi t_data_decoder;
+
     /*!
      * This constructor creates an empty PPDU with the default/empty plcp_header constructor
      */
     ppdu::ppdu()
     {
         header = plcp_header();
-        payload.reserve(MAX_FRAME_SIZE);
     }
 
     /*!
@@ -39,14 +46,13 @@ namespace fun
                 double((16 /* service */ + 8 * (length + 4 /* CRC */) + 6 /* tail */)) /
                 double(rate_params.dbps));
         header = plcp_header(rate, length, num_symbols);
-        payload.reserve(MAX_FRAME_SIZE);
     }
 
 
     /*!
      * This constructor creates a complete PPDU with header and payload.
      */
-    ppdu::ppdu(std::vector<unsigned char> payload, Rate rate) :
+    ppdu::ppdu(const std::vector<unsigned char> & payload, Rate rate) :
         payload(payload)
     {
         RateParams rate_params = RateParams(rate);
@@ -64,21 +70,30 @@ namespace fun
      */
     std::vector<std::complex<double> > ppdu::encode()
     {
-        std::vector<std::complex<double> > header_samples = encoder_header();
-        std::vector<std::complex<double> > payload_samples = encode_data();
-        std::vector<std::complex<double> > ppdu_samples = std::vector<std::complex<double> >(header_samples.size() + payload_samples.size());
-        memcpy(&ppdu_samples[0], &header_samples[0], header_samples.size() * sizeof(std::complex<double>));
-        memcpy(&ppdu_samples[48], payload_samples.data(), payload_samples.size() * sizeof(std::complex<double>));
+        std::vector<std::complex<double> > ppdu_samples((header.num_symbols + 1) * 48);
+        encode(ppdu_samples.data());
         return ppdu_samples;
     }
 
+    void ppdu::encode(std::complex<double> * samples)
+    {
+        encode_header(&samples[0], modulator::get_modulate_kernel(RATE_1_2_BPSK), 1.0);
+        encode_data(&samples[48], modulator::get_modulate_kernel(header.rate), 1.0);
+    }
+
+    void ppdu::encode_subcarriers(std::complex<double> * symbols, double scale)
+    {
+        encode_header(&symbols[0], modulator::get_subcarrier_kernel(RATE_1_2_BPSK), scale);
+        encode_data(&symbols[64], modulator::get_subcarrier_kernel(header.rate), scale);
+    }
+
 
     /*!
      * Uses the rate_params to build the header. Note the header is NOT scrambled.
      * Codes the header using a 1/2 convolutional code. Interleaves the header. And finally
      * modulates the header using BPSK modulation.
      */
-    std::vector<std::complex<double> > ppdu::encoder_header()
+    void ppdu::encode_header(std::complex<double> * samples, modulator::modulate_kernel modulate, double scale)
     {
         // Build the header from the rate field and length
         RateParams rate_params = RateParams(header.rate);
@@ -95,21 +110,18 @@ namespace fun
         memcpy(header_bytes, &h, 3);
 
         // Convolutionally encode the header
-        std::vector<unsigned char> header_symbols(48 /* header is always a single 1/2 BPSK symbol */);
-        viterbi v;
-        v.conv_encode(header_bytes, &header_symbols[0], 18 /* header is always 18 data bits */);
+        unsigned char header_symbols[48 /* header is always a single 1/2 BPSK symbol */];
+        viterbi::conv_encode(header_bytes, header_symbols, 18 /* header is always 18 data bits */, PUNCTURE_NONE);
 
         // Interleave the header
-        std::vector<unsigned char> interleaved = interleaver::interleave(header_symbols);
+        unsigned char interleaved[48];
+        interleaver::interleave(header_symbols, interleaved, 48, RateParams(RATE_1_2_BPSK));
 
         // Modulate the header
-        std::vector<std::complex<double> > modulated = modulator::modulate(interleaved, RATE_1_2_BPSK);
-
-        return modulated;
-
+        modulate(interleaved, samples, 48, scale);
     }
 
-    std::vector<std::complex<double> > ppdu::encode_data()
+    void ppdu::encode_data(std::complex<double> * samples, modulator::modulate_kernel modulate, double scale)
     {
         // Get the RateParams
         RateParams rate_params = RateParams(header.rate);
@@ -125,102 +137,63 @@ namespace fun
 
         unsigned short service_field = 0;
 
+        // The scratch buffers live in this thread's frame arena until the function returns
+        frame_arena::scope scope;
+        frame_arena & arena = frame_arena::local();
+
         // Concatenate the service and payload
-        std::vector<unsigned char> data(num_data_bytes+1, 0);
+        unsigned char * data = arena.allocate<unsigned char>(num_data_bytes + 1);
+        memset(data, 0, num_data_bytes + 1);
         memcpy(&data[0], &service_field, 2);
         memcpy(&data[2], payload.data(), payload.size());
 
-        // Calcualate and append the CRC
-        boost::crc_32_type crc;
-        crc.process_bytes(&data[0], 2 + payload.size());
-        unsigned int calculated_crc = crc.checksum();
-        memcpy(&data[2 + payload.size()], &calculated_crc, 4);
+        // Scramble the service and payload while calculating the CRC
+        int crc_offset = 2 + payload.size();
+        unsigned int calculated_crc = scrambler::scramble_crc(&data[0], &data[0], crc_offset);
 
-        // Scramble the data
-        std::vector<unsigned char> scrambled(num_data_bytes+1, 0);
-        int state = 93, feedback = 0;
-        for(int x = 0; x < num_data_bytes; x++)
-        {
-           feedback = (!!(state & 64)) ^ (!!(state & 8));
-           scrambled[x] = feedback ^ data[x];
-           state = ((state << 1) & 0x7E) | feedback;
-        }
-        data.swap(scrambled);
+        // Append the CRC and scramble it along with the padding
+        memcpy(&data[crc_offset], &calculated_crc, 4);
+        scrambler::scramble(&data[crc_offset], &data[crc_offset], num_data_bytes - crc_offset, crc_offset);
 
-        // Convolutionally encode the data
-        std::vector<unsigned char> data_encoded(num_data_bits * 2, 0);
-        viterbi v;
-        v.conv_encode(&data[0], data_encoded.data(), num_data_bits-6);
+        // The tail bits (the last 6 bits) must be zero after scrambling to terminate the trellis
+        for(int x = num_data_bits - 6; x < num_data_bits; x++) data[x / 8] &= ~(0x80 >> (x % 8));
 
-        // Puncture the data
-        std::vector<unsigned char> data_punctured = puncturer::puncture(data_encoded, header.rate);
+        // Convolutionally encode and puncture the data
+        int coded_bits = num_symbols * rate_params.cbps;
+        unsigned char * data_punctured = arena.allocate<unsigned char>(coded_bits);
+        unsigned char * data_interleaved = arena.allocate<unsigned char>(coded_bits);
+        viterbi::conv_encode(&data[0], data_punctured, num_data_bits-6, puncturer::pattern(rate_params));
 
         // Interleave the data
-        std::vector<unsigned char> data_interleaved = interleaver::interleave(data_punctured);
+        interleaver::interleave(data_punctured, data_interleaved, coded_bits, rate_params);
 
         // Modulated the data
-        std::vector<std::complex<double> > data_modulated = modulator::modulate(data_interleaved, header.rate);
-
-        return data_modulated;
+        modulate(data_interleaved, samples, coded_bits, scale);
     }
 
     // Decode a PLCP header from 48 complex samples
-    bool ppdu::decode_header(std::vector<std::complex<double> > samples)
+    bool ppdu::decode_header(const std::vector<std::complex<double> > & samples)
     {
         assert(samples.size() == 48);
-
-        // Demodulate the header
-        std::vector<unsigned char> demodulated = modulator::demodulate(samples, RATE_1_2_BPSK);
-
-        // Deinterleave the header
-        std::vector<unsigned char> deinterleaved = interleaver::deinterleave(demodulated);
-
-        // Convolutionally decode the header        
-        std::vector<unsigned char> header_bytes(4);
-        viterbi v;
-        v.conv_decode(deinterleaved.data(), header_bytes.data(), 18 /* header is always 18 data bits */);
-
-        // Verify header parity
-        unsigned int header_field;
-        memcpy(&header_field, &header_bytes[0], 3);
-        header_field = htonl(header_field) >> 8;
-        int par = parity(header_field);
-        if(par == 1)
-        {
-            return false;
-        }
-
-        // Get the rate field and length
-        unsigned char rate_field = ((header_field >> 19) & 0xF);
-        unsigned int length = ((header_field >> 6) & 0xFFF);
-
-        // Check for a valid rate
-        bool valid_rate = false;
-        for(int x = 0; x < VALID_RATES.size(); x++) if(VALID_RATES[x] == rate_field) valid_rate = true;
-        if(!valid_rate)
-        {
-            return false;
-        }
-
-        // Calculate the number of symbols
-        RateParams rate_params = RateParams::FromRateField(rate_field);
-        int num_symbols = std::ceil(
-                double((16 /* service */ + 8 * (length + 4 /* CRC */) + 6 /* tail */)) /
-                double(rate_params.dbps));
-
-        // Populate the header fields
-        header.length = length;
-        header.rate = RateParams::FromRateField(rate_field).rate;
-        header.num_symbols = num_symbols;
-
-        // Indicate success
-        return true;
+        return decode_header(samples.data());
     }
 
+    bool ppdu::decode_header(const std::complex<double> * samples, const float * csi)
+    {
+        return signal_decoder::decode(samples, csi, header);
+    }
 
+    bool ppdu::decode_data(const std::vector<std::complex<double> > & samples)
+    {
+        return decode_data(samples, t_data_decoder);
+    }
 
+    bool ppdu::decode_data(const std::vector<std::complex<double> > & samples, viterbi & decoder)
+    {
+        return decode_data(samples.data(), samples.size(), decoder);
+    }
 
-    bool ppdu::decode_data(std::vector<std::complex<double> > samples)
+    bool ppdu::decode_data(const std::complex<double> * samples, int count, viterbi & decoder)
     {
         // Get the RateParams
         RateParams rate_params = RateParams(header.rate);
@@ -229,46 +202,74 @@ namespace fun
         int num_symbols = std::ceil(
                 double((16 /* service */ + 8 * (header.length + 4 /* CRC */) + 6 /* tail */)) /
                 double(rate_params.dbps));
+        assert(count >= num_symbols * 48);
 
         // Calculate the number of data bits/bytes (including padding bits)
         int num_data_bits = num_symbols * rate_params.dbps;
         int num_data_bytes = num_data_bits / 8;
 
-        // Demodulate the data
-        std::vector<unsigned char> demodulated = modulator::demodulate(samples, header.rate);
-
-        // Deinterleave the data
-        std::vector<unsigned char> deinterleaved = interleaver::deinterleave(demodulated);
-
-        // Depuncture the data
-        std::vector<unsigned char> depunctured = puncturer::depuncture(deinterleaved, header.rate);
+        // Demodulate and deinterleave the data one symbol at a time, the decoder reads the
+        // punctured data directly so there is no need for interleaver::deinterleave_depuncture
+        frame_arena::scope scope;
+        frame_arena & arena = frame_arena::local();
+        unsigned char * deinterleaved = arena.allocate<unsigned char>(num_symbols * rate_params.cbps);
+        modulator::demodulate_kernel demodulate = modulator::get_demodulate_kernel(header.rate);
+        for(int s = 0; s < num_symbols; s++)
+        {
+            unsigned char demodulated[288 /* largest cbps */];
+            demodulate(&samples[s * 48], demodulated, 48);
+            interleaver::deinterleave(demodulated, &deinterleaved[s * rate_params.cbps], rate_params.cbps, rate_params);
+        }
 
-        // Convolutionally decode the data
+        // Convolutionally decode the data, the decoder reads the punctured data directly
         int data_bits = 16 /* service */ + (header.length + 4 /* CRC */) * 8 + 6 /* tail bits */;
         int data_bytes = data_bits / 8 + 1;
         data_bits = num_data_bits - 6;
         data_bytes = num_data_bytes;
-        std::vector<unsigned char> decoded(data_bytes);
-        viterbi v;
-        v.conv_decode(&depunctured[0], &decoded[0], data_bits);
-
-        // Descramble the data
-        std::vector<unsigned char> descrambled(num_data_bytes+1, 0);
-        int state = 93, feedback = 0;
-        for(int x = 0; x < num_data_bytes; x++)
+        unsigned char * decoded = arena.allocate<unsigned char>(data_bytes);
+        if(viterbi::parallel_segments(data_bits) > 1)
+        {
+            // Long blocks are split over several threads, the segments need depunctured data
+            unsigned char * depunctured = arena.allocate<unsigned char>(num_data_bits * RATE);
+            int written = puncturer::depuncture(deinterleaved, depunctured, num_symbols * rate_params.cbps, rate_params);
+            memset(&depunctured[written], 127, num_data_bits * RATE - written); // Holes after the last kept symbol
+            decoder.conv_decode_parallel(depunctured, &decoded[0], data_bits);
+        }
+        else
         {
-           feedback = (!!(state & 64)) ^ (!!(state & 8));
-           descrambled[x] = feedback ^ decoded[x];
-           state = ((state << 1) & 0x7E) | feedback;
+            decoder.conv_decode(&deinterleaved[0], &decoded[0], data_bits, puncturer::pattern(rate_params));
         }
-        decoded.swap(descrambled);
 
-        // Calculate the CRC
-        boost::crc_32_type crc;
-        crc.process_bytes(&decoded[0], 2 + header.length);
-        unsigned int calculated_crc = crc.checksum();
+        return descramble_data(&decoded[0]);
+    }
+
+    bool ppdu::descramble_data(unsigned char * decoded)
+    {
+        if(!check_data(decoded)) return false;
+
+        // Copy the payload
+        payload.resize(header.length);
+        memcpy(&payload[0], &decoded[2 /* skip the service field */], header.length);
+        return true;
+    }
+
+    bool ppdu::descramble_data(unsigned char * decoded, payload_buffer & payload_out)
+    {
+        if(!check_data(decoded)) return false;
+
+        payload_out = payload_pool::acquire(&decoded[2 /* skip the service field */], header.length);
+        return true;
+    }
+
+    bool ppdu::check_data(unsigned char * decoded)
+    {
+        // Descramble the service and payload while calculating the CRC, then descramble
+        // the given CRC (the padding isn't needed)
+        int crc_offset = 2 + header.length;
+        unsigned int calculated_crc = scrambler::descramble_crc(&decoded[0], &decoded[0], crc_offset);
+        scrambler::scramble(&decoded[crc_offset], &decoded[crc_offset], 4, crc_offset);
         unsigned int given_crc = 0;
-        memcpy(&given_crc, &decoded[2 + header.length], 4);
+        memcpy(&given_crc, &decoded[crc_offset], 4);
 
         // Verify the CRC
         if(given_crc != calculated_crc)
@@ -279,20 +280,11 @@ namespace fun
         }
         else
         {
-            // Copy the payload
-    //        std::vector<unsigned char> payload(length);
-            payload.resize(header.length);
-            memcpy(&payload[0], &decoded[2 /* skip the service field */], header.length);
-
             // Fill the output values
-    //        data_out.rate = rate;
             memcpy(&header.service, &decoded[0], 2);
-    //        data_out.length = length;
             // Indicate success
             return true;
         }
-
     }
 
 }
-
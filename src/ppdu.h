@@ -13,11 +13,15 @@
 #include <complex>
 #include <vector>
 #include "rates.h"
+#include "payload_pool.h"
+#include "modulator.h"
 
 #define MAX_FRAME_SIZE 2000
 
 namespace fun
 {
+    class viterbi;
+
     /*!
      * \brief The plcp_header struct is a container for PLCP Headers and their
      *  respective parameters.
@@ -107,7 +111,7 @@ namespace fun
          * \param payload The payload/data/MPDU to be transmitted.
          * \param rate The PHY rate for this frame.
          */
-        ppdu(std::vector<unsigned char> payload, Rate rate);
+        ppdu(const std::vector<unsigned char> & payload, Rate rate);
 
         /******************
          * Public Members *
@@ -119,6 +123,22 @@ namespace fun
          */
         std::vector<std::complex<double> > encode();
 
+        /*!
+         * \brief Encodes the ppdu into a caller provided buffer.
+         * \param samples The header symbol followed by the data symbols, needs room for
+         *        (get_num_symbols() + 1) * 48 samples.
+         */
+        void encode(std::complex<double> * samples);
+
+        /*!
+         * \brief Encodes the ppdu straight onto the data subcarriers of its OFDM symbols.
+         * \param symbols The header symbol followed by the data symbols, 64 subcarriers each as in
+         *        symbol_mapper::map, needs room for (get_num_symbols() + 1) * 64 samples. Only the
+         *        data subcarriers are written, see symbol_mapper::map_pilots.
+         * \param scale [Optional] Factor for the constellation points, see modulator::modulate_subcarriers.
+         */
+        void encode_subcarriers(std::complex<double> * symbols, double scale = 1.0);
+
         /*!
          * \brief Public interface for decoding a plcp_header.
          * \param samples Complex samples representing the encoded header symbol.
@@ -127,7 +147,16 @@ namespace fun
          *  If successful the object's #header field is populated appropriately with
          *  the decoded fields.
          */
-        bool decode_header(std::vector<std::complex<double> > samples);
+        bool decode_header(const std::vector<std::complex<double> > & samples);
+
+        /*!
+         * \brief Decodes a plcp_header from a caller provided buffer.
+         * \param samples The 48 complex samples of the encoded header symbol.
+         * \param csi [Optional] SNR of the subcarrier of each sample (see tagged_csi_vector) to
+         *        weight the soft bits with, NULL for unweighted soft bits.
+         * \return Same as decode_header(std::vector<std::complex<double> >), see signal_decoder::decode.
+         */
+        bool decode_header(const std::complex<double> * samples, const float * csi = NULL);
 
         /*!
          * \brief Public interface for decoding the PHY payload into a PPDU.
@@ -137,13 +166,48 @@ namespace fun
          *  of the payload. If successful the object's #payload field is populated
          *  with the decoded payload/MPDU.
          */
-        bool decode_data(std::vector<std::complex<double> > samples);
+        bool decode_data(const std::vector<std::complex<double> > & samples);
+
+        /*!
+         * \brief Decodes the PHY payload using the caller's Viterbi decoder.
+         * \param samples Complex samples representing the encoded payload symbols.
+         * \param decoder Viterbi decoder whose state is reused across calls.
+         * \return Same as decode_data(std::vector<std::complex<double> >).
+         */
+        bool decode_data(const std::vector<std::complex<double> > & samples, viterbi & decoder);
+
+        /*!
+         * \brief Decodes the PHY payload from a caller provided buffer.
+         * \param samples Complex samples representing the encoded payload symbols.
+         * \param count Number of samples, at least get_num_symbols() * 48.
+         * \param decoder Viterbi decoder whose state is reused across calls.
+         * \return Same as decode_data(std::vector<std::complex<double> >).
+         */
+        bool decode_data(const std::complex<double> * samples, int count, viterbi & decoder);
+
+        /*!
+         * \brief Finishes decoding the PHY payload from the convolutionally decoded bytes.
+         * \param decoded The decoded DATA field (service, payload, CRC), descrambled in place.
+         * \return Same as decode_data(std::vector<std::complex<double> >).
+         *
+         * This is the last step of #decode_data, for callers that run the Viterbi decoder
+         * themselves (e.g. symbol by symbol). The header length must already be set.
+         */
+        bool descramble_data(unsigned char * decoded);
+
+        /*!
+         * \brief Same as descramble_data(unsigned char *) but puts the payload into a pooled buffer.
+         * \param decoded The decoded DATA field (service, payload, CRC), descrambled in place.
+         * \param payload_out Gets the payload if the CRC is valid, the PPDU's own payload is left empty.
+         * \return Whether the CRC is valid.
+         */
+        bool descramble_data(unsigned char * decoded, payload_buffer & payload_out);
 
 
         Rate get_rate(){return header.rate;}     //!< Get this PPDU's PHY tx rate
         int get_length(){return header.length;}  //!< Get this PPDU's payload length
         int get_num_symbols(){return header.num_symbols;} //!< Get the number of OFDM symbols in this PPDU
-        std::vector<unsigned char> get_payload(){return payload;} //!< Get the payload of this PPDU.
+        const std::vector<unsigned char> & get_payload() const {return payload;} //!< Get the payload of this PPDU.
 
     private:
 
@@ -153,16 +217,27 @@ namespace fun
         /*!
          * \brief Encodes this PPDU's header. The header is always encoded with
          *  BPSK modulation and 1/2 rate convolutional code.
-         * \return The modulated header symbol.
+         * \param samples Output for the modulated header symbol.
+         * \param modulate Writes the samples, modulator::get_modulate_kernel or get_subcarrier_kernel.
+         * \param scale Factor for the constellation points.
          */
-        std::vector<std::complex<double> > encoder_header();
+        void encode_header(std::complex<double> * samples, modulator::modulate_kernel modulate, double scale);
 
         /*!
          * \brief Encodes this PPDU's payload. The payload is encoded at the rate
          *  specified in the header.rate field.
-         * \return The modulated data.
+         * \param samples Output for the modulated data symbols.
+         * \param modulate Writes the samples, modulator::get_modulate_kernel or get_subcarrier_kernel
+         *  for the header rate.
+         * \param scale Factor for the constellation points.
+         */
+        void encode_data(std::complex<double> * samples, modulator::modulate_kernel modulate, double scale);
+
+        /*!
+         * \brief Descrambles the decoded DATA field in place and verifies its CRC.
+         * \return Whether the CRC is valid, if so the service field is filled in.
          */
-        std::vector<std::complex<double> > encode_data();
+        bool check_data(unsigned char * decoded);
 
     };
 
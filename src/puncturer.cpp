@@ -14,6 +14,30 @@
 namespace fun
 {
 
+    // The pattern is a template parameter so that the period and mask are constants
+    template<int P>
+    static int puncture_pattern(const unsigned char * data, unsigned char * punctured, int count)
+    {
+        int index = 0;
+        for(int x = 0; x < count; x++)
+        {
+            if((PUNCTURE_KEEP[P] >> (x % PUNCTURE_PERIOD[P])) & 1) punctured[index++] = data[x];
+        }
+        return index;
+    }
+
+    template<int P>
+    static int depuncture_pattern(const unsigned char * data, unsigned char * depunctured, int count)
+    {
+        int index = 0;
+        for(int x = 0; x < count; index++)
+        {
+            if((PUNCTURE_KEEP[P] >> (index % PUNCTURE_PERIOD[P])) & 1) depunctured[index] = data[x++];
+            else depunctured[index] = 127;
+        }
+        return index;
+    }
+
     /*!
      *  Punctures the convolutionally encoded data based on the desired PHY rate in rate_params.
      *  Suported Rates:
@@ -21,106 +45,41 @@ namespace fun
      *  - 2/3
      *  - 3/4
      */
-    std::vector<unsigned char> puncturer::puncture(std::vector<unsigned char> data, RateParams rate_params)
+    int puncturer::puncture(const unsigned char * data, unsigned char * punctured, int count, const RateParams & rate_params)
     {
-        // Puncture the data
-        int count, index;
-        switch(rate_params.rate)
-        {
-            // Nothing to do
-            case RATE_1_2_BPSK: case RATE_1_2_QPSK: case RATE_1_2_QAM16:
-                return data;
-                break;
-
-            // Puncture from 1/2 to 3/4
-            case RATE_3_4_BPSK: case RATE_3_4_QPSK: case RATE_3_4_QAM16: case RATE_3_4_QAM64:
-            {
-                count = round(data.size() * rate_params.rel_rate);
-                std::vector<unsigned char> punc_buff_34(count);
-                index = 0;
-                for(int x = 0; x < data.size(); x += 6)
-                {
-                    punc_buff_34[index++] = data[x + 0];
-                    punc_buff_34[index++] = data[x + 1];
-                    punc_buff_34[index++] = data[x + 3];
-                    punc_buff_34[index++] = data[x + 5];
-                }
-                return punc_buff_34;
-            }
-            break;
+        typedef int (*kernel)(const unsigned char *, unsigned char *, int);
+        static const kernel kernels[PUNCTURE_COUNT] = { &puncture_pattern<PUNCTURE_NONE>, &puncture_pattern<PUNCTURE_2_3>, &puncture_pattern<PUNCTURE_3_4> };
+        return kernels[pattern(rate_params)](data, punctured, count);
+    }
 
-            // Puncture from 1/2 to 2/3
-            case RATE_2_3_BPSK: case RATE_2_3_QPSK: case RATE_2_3_QAM16: case RATE_2_3_QAM64:
-            {
-                count = round(data.size() * rate_params.rel_rate);
-                std::vector<unsigned char> punc_buff_23(count);
-                index = 0;
-                for(int x = 0; x < data.size(); x += 4)
-                {
-                    punc_buff_23[index++] = data[x + 0];
-                    punc_buff_23[index++] = data[x + 2];
-                    punc_buff_23[index++] = data[x + 3];
-                }
-                return punc_buff_23;
-            }
-            break;
-        }
+    std::vector<unsigned char> puncturer::puncture(const std::vector<unsigned char> & data, RateParams rate_params)
+    {
+        std::vector<unsigned char> punctured(round(data.size() * rate_params.rel_rate));
+        punctured.resize(puncture(data.data(), punctured.data(), data.size(), rate_params));
+        return punctured;
     }
 
     /*!
-     *  Depunctures the punctured data by inserting 0's into the "puncture holes" based on the PHY
-     *  rate in rate_params.
+     *  Depunctures the punctured data by inserting erasures (127) into the "puncture holes"
+     *  based on the PHY rate in rate_params. The last pattern position is always kept, so
+     *  depuncturing stops right after the last input symbol.
      *  Supported Rates:
      *  - 1/2
      *  - 2/3
      *  - 3/4
      */
-    std::vector<unsigned char> puncturer::depuncture(std::vector<unsigned char> data, RateParams rate_params)
+    int puncturer::depuncture(const unsigned char * data, unsigned char * depunctured, int count, const RateParams & rate_params)
     {
-        int sym_buffer_index = 0;
-        int psc = 0;
-        switch(rate_params.rate)
-        {
-            // Nothing to do
-            case RATE_1_2_BPSK: case RATE_1_2_QPSK: case RATE_1_2_QAM16:
-                return data;
-                break;
-
-            // De-puncture from 3/4 to 1/2 coding rate
-            case RATE_3_4_BPSK: case RATE_3_4_QPSK: case RATE_3_4_QAM16: case RATE_3_4_QAM64:
-            {
-                psc = round(data.size() / rate_params.rel_rate);
-                std::vector<unsigned char> sym_buffer34(psc);
-                for(int x = 0; x < data.size(); x += 4)
-                {
-                  sym_buffer34[sym_buffer_index++] = data[x + 0];
-                  sym_buffer34[sym_buffer_index++] = data[x + 1];
-                  sym_buffer34[sym_buffer_index++] = 127;
-                  sym_buffer34[sym_buffer_index++] = data[x + 2];
-                  sym_buffer34[sym_buffer_index++] = 127;
-                  sym_buffer34[sym_buffer_index++] = data[x + 3];
-                }
-                return sym_buffer34;
-                break;
-            }
+        typedef int (*kernel)(const unsigned char *, unsigned char *, int);
+        static const kernel kernels[PUNCTURE_COUNT] = { &depuncture_pattern<PUNCTURE_NONE>, &depuncture_pattern<PUNCTURE_2_3>, &depuncture_pattern<PUNCTURE_3_4> };
+        return kernels[pattern(rate_params)](data, depunctured, count);
+    }
 
-            // De-ouncture from 2/3 to 1/2 coding rate
-            case RATE_2_3_BPSK: case RATE_2_3_QPSK: case RATE_2_3_QAM16: case RATE_2_3_QAM64:
-            {
-                psc = round(data.size() / rate_params.rel_rate);
-                std::vector<unsigned char> sym_buffer23(psc);
-                for(int x = 0; x < data.size(); x += 3)
-                {
-                  sym_buffer23[sym_buffer_index++] = data[x + 0];
-                  sym_buffer23[sym_buffer_index++] = 127;
-                  sym_buffer23[sym_buffer_index++] = data[x + 1];
-                  sym_buffer23[sym_buffer_index++] = data[x + 2];
-                }
-                return sym_buffer23;
-                break;
-            }
-        }
+    std::vector<unsigned char> puncturer::depuncture(const std::vector<unsigned char> & data, RateParams rate_params)
+    {
+        std::vector<unsigned char> depunctured(round(data.size() / rate_params.rel_rate) + PUNCTURE_PERIOD[PUNCTURE_COUNT-1]);
+        depunctured.resize(depuncture(data.data(), depunctured.data(), data.size(), rate_params));
+        return depunctured;
     }
 
 }
-
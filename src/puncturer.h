@@ -11,10 +11,38 @@
 #ifndef PUNCTURER_H
 #define PUNCTURER_H
 
+#include <vector>
+
 #include "rates.h"
 
 namespace fun
 {
+    /*!
+     * \brief The puncturing patterns of the convolutional code.
+     */
+    enum puncturing : int
+    {
+        PUNCTURE_NONE = 0, //!< Rate 1/2, every coded symbol is sent
+        PUNCTURE_2_3 = 1,  //!< Rate 2/3, the 2nd of every 4 coded symbols is dropped
+        PUNCTURE_3_4 = 2,  //!< Rate 3/4, the 3rd and 5th of every 6 coded symbols are dropped
+        PUNCTURE_COUNT = 3 //!< Number of patterns
+    };
+
+    //! Period of each puncturing pattern in coded symbols
+    static constexpr int PUNCTURE_PERIOD[PUNCTURE_COUNT] = { 2, 4, 6 };
+
+    //! The coded symbols of a period that are sent, bit k set if symbol k is kept
+    static constexpr int PUNCTURE_KEEP[PUNCTURE_COUNT] = { 0x3, 0xD, 0x2B };
+
+    //! The puncturing pattern of each #Rate
+    static constexpr puncturing PUNCTURE_OF_RATE[RATE_COUNT] =
+    {
+        PUNCTURE_NONE, PUNCTURE_2_3, PUNCTURE_3_4,  // BPSK
+        PUNCTURE_NONE, PUNCTURE_2_3, PUNCTURE_3_4,  // QPSK
+        PUNCTURE_NONE, PUNCTURE_2_3, PUNCTURE_3_4,  // QAM16
+        PUNCTURE_2_3, PUNCTURE_3_4                  // QAM64
+    };
+
     /*!
      * \brief The puncturer class
      *
@@ -33,7 +61,17 @@ namespace fun
          * \param rate_params The parameters for the PHY Rate from which the coding rate is extracted.
          * \return Vector of the punctured data.
          */
-        static std::vector<unsigned char> puncture(std::vector<unsigned char> data, RateParams rate_params);
+        static std::vector<unsigned char> puncture(const std::vector<unsigned char> & data, RateParams rate_params);
+
+        /*!
+         * \brief Punctures the convolutionally encoded data into a caller provided buffer.
+         * \param data The convolutionally encoded data to be punctured.
+         * \param punctured The punctured data, needs room for count * rate_params.rel_rate symbols.
+         * \param count Number of coded symbols in data.
+         * \param rate_params The parameters for the PHY Rate from which the coding rate is extracted.
+         * \return Number of symbols written to punctured.
+         */
+        static int puncture(const unsigned char * data, unsigned char * punctured, int count, const RateParams & rate_params);
 
         /*!
         * \brief depunctures the data by inserting 0's in the "puncture holes"
@@ -41,7 +79,28 @@ namespace fun
         * \param rate_params The parameters for the PHY Rate from which the coding rate is extracted.
         * \return Vector of the depunctured data.
         */
-        static std::vector<unsigned char> depuncture(std::vector<unsigned char> data, RateParams rate_params);
+        static std::vector<unsigned char> depuncture(const std::vector<unsigned char> & data, RateParams rate_params);
+
+        /*!
+        * \brief depunctures the data into a caller provided buffer.
+        * \param data The punctured data to be depunctured.
+        * \param depunctured The depunctured data with erasures in the "puncture holes", needs room
+        *        for count / rate_params.rel_rate symbols.
+        * \param count Number of symbols in data.
+        * \param rate_params The parameters for the PHY Rate from which the coding rate is extracted.
+        * \return Number of symbols written to depunctured.
+        */
+        static int depuncture(const unsigned char * data, unsigned char * depunctured, int count, const RateParams & rate_params);
+
+        /*!
+         * \brief Gets the puncturing pattern of a PHY rate.
+         * \param rate_params The parameters for the PHY Rate from which the coding rate is extracted.
+         * \return The puncturing pattern, e.g. for viterbi::conv_decode on the punctured data.
+         */
+        static constexpr puncturing pattern(const RateParams & rate_params)
+        {
+            return PUNCTURE_OF_RATE[rate_params.rate];
+        }
     };
 }
 
@@ -123,6 +123,34 @@ namespace fun
                 ++bits;
             }
         }
+
+        /*!
+         * \brief Decode with the confidences scaled by a weight
+         *
+         * The decision boundaries are the same as in decode(double, unsigned char *), only the
+         * distance of each bit from its boundary is scaled, e.g. by the reliability of the
+         * subcarrier. A weight of 1 gives the same output as decode(double, unsigned char *).
+         *
+         * \param sym
+         * \param bits
+         * \param weight between 0 and 1
+         */
+        inline void decode (double sym, unsigned char *bits, double weight)
+        {
+            int pt = sym * d_scale_d;
+            int flip = 1; // +1 or -1 -- for gray coding
+            int amp = (1 << (NumBits-1)) << d_gain;
+            // unrolled with -O3
+            for (int i = 0; i < NumBits; ++i)
+            {
+                *bits = clamp(int(flip * pt * weight) + 128);
+                int bit = sign(pt);
+                pt -= bit * amp;
+                flip = -bit;
+                amp /= 2;
+                ++bits;
+            }
+        }
     };
 }
 
@@ -4,13 +4,15 @@
  *  The PHY rate parameters are used by the PPDU class to correctly encode and decode
  *  PHY frames.  The RateParams struct holds all the necessary parameters for each PPDU
  *  and contains constructors for getting the necessary parameters either from the desired
- *  transmit rate or from the rate field in the received PHY frame.
+ *  transmit rate or from the rate field in the received PHY frame. The parameters are
+ *  a constexpr table so they are available at compile time.
  */
 
 #ifndef RATES_H
 #define RATES_H
 
 #include <assert.h>
+#include <stdexcept>
 #include <vector>
 #include <string>
 
@@ -18,7 +20,7 @@ namespace fun
 {    
 
     /*! \brief Valid rate field values */
-    static std::vector<unsigned char> VALID_RATES = {0xD, 0xE, 0xF, 0x5, 0x6, 0x7, 0x9, 0xA, 0xB, 0x1, 0x3};
+    static constexpr unsigned char VALID_RATES[] = {0xD, 0xE, 0xF, 0x5, 0x6, 0x7, 0x9, 0xA, 0xB, 0x1, 0x3};
 
 
     /*! \brief An enum for referencing the different PHY data rates by name.
@@ -40,14 +42,17 @@ namespace fun
         RATE_2_3_QAM16 = 7, //!< Rate 2/3 code : QAM16 modulation
         RATE_3_4_QAM16 = 8, //!< Rate 3/4 code : QAM16 modulation
         RATE_2_3_QAM64 = 9, //!< Rate 2/3 code : QAM64 modulation
-        RATE_3_4_QAM64 = 10 //!< Rate 3/4 code : QAM64 modulation
+        RATE_3_4_QAM64 = 10, //!< Rate 3/4 code : QAM64 modulation
+        RATE_COUNT = 11     //!< Number of rates
     };
 
     // Parameters for each data rate
     /*!
      * \brief The RateParams struct
      *
-     * Parameters for each data rate
+     * Parameters for each data rate. The parameters of every rate are in the constexpr
+     * #RATE_TABLE, so constructing a RateParams is a copy of one table entry and can be
+     * done at compile time, e.g. to specialize kernels for a rate.
      */
     struct RateParams
     {
@@ -57,7 +62,7 @@ namespace fun
         int bpsc;                 //!< Bits per subcarrier
         Rate rate;                //!< Rate enum value
         double rel_rate;          //!< Relative coding rate (relative to 1/2)
-        std::string name;         //!< Display name
+        const char * name;        //!< Display name
 
         /*!
          * \brief RateParams constructor
@@ -65,134 +70,20 @@ namespace fun
          * Populates the rate parameters appropriately for the given PHY Rate
          * \param _rate the PHY Rate for which the corresponding parameters are desired
          */
-        RateParams(Rate _rate)
+        constexpr RateParams(Rate _rate);
+
+        /*!
+         * \brief RateParams constructor for the entries of #RATE_TABLE
+         */
+        constexpr RateParams(unsigned char _rate_field, int _cbps, int _dbps, int _bpsc, Rate _rate, double _rel_rate, const char * _name) :
+            rate_field(_rate_field),
+            cbps(_cbps),
+            dbps(_dbps),
+            bpsc(_bpsc),
+            rate(_rate),
+            rel_rate(_rel_rate),
+            name(_name)
         {
-            switch(_rate)
-            {
-                // 1/2 BPSK
-                case RATE_1_2_BPSK:
-                    rate_field = 0xD;
-                    cbps = 48;
-                    dbps = 24;
-                    rate = RATE_1_2_BPSK;
-                    rel_rate = 1.0;
-                    bpsc = 1;
-                    name = "1/2 BPSK";
-                    break;
-
-                // 2/3 BPSK
-                case RATE_2_3_BPSK:
-                    rate_field = 0xE;
-                    cbps = 48;
-                    dbps = 32;
-                    rate = RATE_2_3_BPSK;
-                    rel_rate = 3.0 / 4.0;
-                    bpsc = 1;
-                    name = "2/3 BPSK";
-                    break;
-
-                // 3/4 BPSK
-                case RATE_3_4_BPSK:
-                    rate_field = 0xF;
-                    cbps = 48;
-                    dbps = 36;
-                    rate = RATE_3_4_BPSK;
-                    rel_rate = 2.0 / 3.0;
-                    bpsc = 1;
-                    name = "3/4 BPSK";
-                    break;
-
-                // 1/2 QPSK
-                case RATE_1_2_QPSK:
-                    rate_field = 0x5;
-                    cbps = 96;
-                    dbps = 48;
-                    rate = RATE_1_2_QPSK;
-                    rel_rate = 1.0;
-                    bpsc = 2;
-                    name = "1/2 QPSK";
-                    break;
-
-                // 2/3 QPSK
-                case RATE_2_3_QPSK:
-                    rate_field = 0x6;
-                    cbps = 96;
-                    dbps = 64;
-                    rate = RATE_2_3_QPSK;
-                    rel_rate = 3.0 / 4.0;
-                    bpsc = 2;
-                    name = "2/3 QPSK";
-                    break;
-
-                // 3/4 QPSK
-                case RATE_3_4_QPSK:
-                    rate_field = 0x7;
-                    cbps = 96;
-                    dbps = 72;
-                    rate = RATE_3_4_QPSK;
-                    rel_rate = 2.0 / 3.0;
-                    bpsc = 2;
-                    name = "3/4 QPSK";
-                    break;
-
-                // 1/2 QAM16
-                case RATE_1_2_QAM16:
-                    rate_field = 0x9;
-                    cbps = 192;
-                    dbps = 96;
-                    rate = RATE_1_2_QAM16;
-                    rel_rate = 1.0;
-                    bpsc = 4;
-                    name = "1/2 QAM16";
-                    break;
-
-                // 2/3 QAM16
-                case RATE_2_3_QAM16:
-                    rate_field = 0xA;
-                    cbps = 192;
-                    dbps = 128;
-                    rate = RATE_2_3_QAM16;
-                    rel_rate = 3.0 / 4.0;
-                    bpsc = 4;
-                    name = "2/3 QAM16";
-                    break;
-
-                // 3/4 QAM16
-                case RATE_3_4_QAM16:
-                    rate_field = 0xB;
-                    cbps = 192;
-                    dbps = 144;
-                    rate = RATE_3_4_QAM16;
-                    rel_rate = 2.0 / 3.0;
-                    bpsc = 4;
-                    name = "3/4 QAM16";
-                    break;
-
-                // 2/3 QAM64
-                case RATE_2_3_QAM64:
-                    rate_field = 0x1;
-                    cbps = 288;
-                    dbps = 192;
-                    rate = RATE_2_3_QAM64;
-                    rel_rate = 3.0 / 4.0;
-                    bpsc = 6;
-                    name = "2/3 QAM64";
-                    break;
-
-                // 3/4 QAM64
-                case RATE_3_4_QAM64:
-                    rate_field = 0x3;
-                    cbps = 288;
-                    dbps = 216;
-                    rate = RATE_3_4_QAM64;
-                    rel_rate = 2.0 / 3.0;
-                    bpsc = 6;
-                    name = "3/4 QAM64";
-                    break;
-
-                default:
-                    break;
-            }
         }
 
         /*!
@@ -202,52 +93,60 @@ namespace fun
          * This function is used to get the appropriate rate parameters for the
          * received packet based on the rate field in the received packet header.
          *
-         * \param rate_field The rate field bits from the packet header
+         * \param rate_field The rate field bits from the packet header, must be one of #VALID_RATES
          * \return #RateParams object with the appropriate parameters for that rate
+         * \throws std::invalid_argument if the rate field isn't valid, see #IsValidRateField
          */
-        static RateParams FromRateField(unsigned char rate_field)
-        {
-            switch(rate_field)
-            {
-                // 1/2 BPSK
-                case 0xD: return RateParams(RATE_1_2_BPSK); break;
-
-                // 2/3 BPSK
-                case 0xE: return RateParams(RATE_2_3_BPSK); break;
+        static constexpr RateParams FromRateField(unsigned char rate_field);
 
-                // 3/4 BPSK
-                case 0xF: return RateParams(RATE_3_4_BPSK); break;
-
-                // 1/2 QPSK
-                case 0x5: return RateParams(RATE_1_2_QPSK); break;
-
-                // 2/3 QPSK
-                case 0x6: return RateParams(RATE_2_3_QPSK); break;
-
-                // 3/4 QPSK
-                case 0x7: return RateParams(RATE_3_4_QPSK); break;
+        /*!
+         * \brief Whether a rate field from a packet header is one of #VALID_RATES.
+         */
+        static constexpr bool IsValidRateField(unsigned char rate_field);
+    };
 
-                // 1/2 QAM16
-                case 0x9: return RateParams(RATE_1_2_QAM16); break;
+    /*! \brief The parameters of every rate, indexed by #Rate */
+    static constexpr RateParams RATE_TABLE[RATE_COUNT] =
+    {
+        //          field  cbps  dbps  bpsc  rate            rel_rate    name
+        RateParams(0xD,   48,   24,   1,    RATE_1_2_BPSK,  1.0,        "1/2 BPSK"),
+        RateParams(0xE,   48,   32,   1,    RATE_2_3_BPSK,  3.0 / 4.0,  "2/3 BPSK"),
+        RateParams(0xF,   48,   36,   1,    RATE_3_4_BPSK,  2.0 / 3.0,  "3/4 BPSK"),
+        RateParams(0x5,   96,   48,   2,    RATE_1_2_QPSK,  1.0,        "1/2 QPSK"),
+        RateParams(0x6,   96,   64,   2,    RATE_2_3_QPSK,  3.0 / 4.0,  "2/3 QPSK"),
+        RateParams(0x7,   96,   72,   2,    RATE_3_4_QPSK,  2.0 / 3.0,  "3/4 QPSK"),
+        RateParams(0x9,   192,  96,   4,    RATE_1_2_QAM16, 1.0,        "1/2 QAM16"),
+        RateParams(0xA,   192,  128,  4,    RATE_2_3_QAM16, 3.0 / 4.0,  "2/3 QAM16"),
+        RateParams(0xB,   192,  144,  4,    RATE_3_4_QAM16, 2.0 / 3.0,  "3/4 QAM16"),
+        RateParams(0x1,   288,  192,  6,    RATE_2_3_QAM64, 3.0 / 4.0,  "2/3 QAM64"),
+        RateParams(0x3,   288,  216,  6,    RATE_3_4_QAM64, 2.0 / 3.0,  "3/4 QAM64")
+    };
 
-                // 2/3 QAM16
-                case 0xA: return RateParams(RATE_2_3_QAM16); break;
+    /*! \brief The #Rate of each 4 bit SIGNAL rate field, -1 if the field isn't valid */
+    static constexpr int RATE_FROM_FIELD[16] =
+    {
+        -1, RATE_2_3_QAM64, -1, RATE_3_4_QAM64, -1, RATE_1_2_QPSK, RATE_2_3_QPSK, RATE_3_4_QPSK,
+        -1, RATE_1_2_QAM16, RATE_2_3_QAM16, RATE_3_4_QAM16, -1, RATE_1_2_BPSK, RATE_2_3_BPSK, RATE_3_4_BPSK
+    };
 
-                // 3/4 QAM16
-                case 0xB: return RateParams(RATE_3_4_QAM16); break;
+    constexpr RateParams::RateParams(Rate _rate) :
+        RateParams(RATE_TABLE[_rate])
+    {
+    }
 
-                // 2/3 QAM64
-                case 0x1: return RateParams(RATE_2_3_QAM64); break;
+    constexpr RateParams RateParams::FromRateField(unsigned char rate_field)
+    {
+        return IsValidRateField(rate_field) ? RATE_TABLE[RATE_FROM_FIELD[rate_field]]
+                                            : throw std::invalid_argument("invalid rate field");
+    }
 
-                // 3/4 QAM64
-                case 0x3: return RateParams(RATE_3_4_QAM64); break;
+    constexpr bool RateParams::IsValidRateField(unsigned char rate_field)
+    {
+        return rate_field < 16 && RATE_FROM_FIELD[rate_field] >= 0;
+    }
 
-                default:
-                    assert(false);
-                    break;
-            }
-        }
-    };
+    static_assert(RateParams(RATE_3_4_QAM64).dbps == 216, "rate table is out of order");
+    static_assert(RateParams::FromRateField(0xB).rate == RATE_3_4_QAM16, "rate field table is out of order");
 }
 
 
@@ -13,7 +13,7 @@ namespace fun
     /*!
      * This constructor shows exactly what parameters need to be set for the receiver.
      */
-    receiver::receiver(void (*callback)(std::vector<std::vector<unsigned char> > packets), double freq, double samp_rate, double rx_gain, std::string device_addr) :
+    receiver::receiver(void (*callback)(const std::vector<payload_buffer> & packets), double freq, double samp_rate, double rx_gain, std::string device_addr) :
         receiver(callback, usrp_params(freq, samp_rate, 20, rx_gain, 1.0, device_addr))
     {
     }
@@ -21,7 +21,7 @@ namespace fun
     /*!
      * This constructor is for those who feel more comfortable using the usrp_params struct.
      */
-    receiver::receiver(void (*callback)(std::vector<std::vector<unsigned char> > packets), usrp_params params) :
+    receiver::receiver(void (*callback)(const std::vector<payload_buffer> & packets), usrp_params params) :
         m_usrp(params),
         m_samples(NUM_RX_SAMPLES),
         m_callback(callback),
@@ -47,7 +47,7 @@ namespace fun
 
             m_usrp.get_samples(NUM_RX_SAMPLES, m_samples);
 
-            std::vector<std::vector<unsigned char> > packets =
+            const std::vector<payload_buffer> & packets =
                     m_rec_chain.process_samples(m_samples);
 
             m_callback(packets);
@@ -75,4 +75,15 @@ namespace fun
     {
         sem_post(&m_pause);
     }
+
+    /*!
+     *  The receiver is paused while the filter is replaced so that the receiver_chain isn't in the
+     *  middle of processing samples.
+     */
+    void receiver::set_frame_filter(const frame_filter & filter)
+    {
+        pause();
+        m_rec_chain.set_frame_filter(filter);
+        resume();
+    }
 }
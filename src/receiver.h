@@ -23,7 +23,9 @@ namespace fun
      *  This is the easiest way to start receiving 802.11a OFDM frames out of the box.
      *
      *  Usage: To receive packets simply create a receiver object and pass it a callback
-     *  function that takes a std::vector<std::vector<unsigned char> > as an input parameter.
+     *  function that takes a const std::vector<payload_buffer> & as an input parameter. The
+     *  vector is only valid during the callback, copy the payload_buffer handles (which doesn't
+     *  copy the bytes) to keep packets around longer.
      *  The receiver object then automatically creates a separate thread that pulls samples
      *  from the USRP and processes them with the receive chain. The received packets (if any)
      *  are then passed into the callback function where the user is able to process them further.
@@ -55,7 +57,7 @@ namespace fun
          *    + tx_gain -> 20 even though it is irrelevant for the receiver
          *    + amp -> 1.0 even though it is irrelevant for the receiver
          */
-        receiver(void(*callback)(std::vector<std::vector<unsigned char> > packets), double freq = 5.72e9, double samp_rate = 5e6, double rx_gain = 20, std::string device_addr = "");
+        receiver(void(*callback)(const std::vector<payload_buffer> & packets), double freq = 5.72e9, double samp_rate = 5e6, double rx_gain = 20, std::string device_addr = "");
 
         /*!
          * \brief Constructor for the receiver that uses the usrp_params struct
@@ -70,7 +72,7 @@ namespace fun
          *  - device ip address -> "" (empty string will default to letting the UHD api
          *    automatically find an available USRP)
          */
-        receiver(void(*callback)(std::vector<std::vector<unsigned char> > packets), usrp_params params = usrp_params());
+        receiver(void(*callback)(const std::vector<payload_buffer> & packets), usrp_params params = usrp_params());
 
         /*!
          * \brief Pauses the receiver thread.
@@ -82,11 +84,21 @@ namespace fun
          */
         void resume();
 
+        /*!
+         * \brief Only passes the frames that match a filter to the callback.
+         * \param filter The new filter, frame_filter() to receive every frame.
+         *
+         * Frames that don't match are dropped as soon as the filtered bytes are decoded, see
+         * frame_decoder::set_filter. Waits for the receiver thread like pause() does, so it must
+         * not be called while the receiver is paused.
+         */
+        void set_frame_filter(const frame_filter & filter);
+
     private:
 
         void receiver_chain_loop(); //!< Infinite while loop where samples are received from USRP and processed by the receiver_chain
 
-        void (*m_callback)(std::vector<std::vector<unsigned char> > packets); //!< Callback function pointer
+        void (*m_callback)(const std::vector<payload_buffer> & packets); //!< Callback function pointer
 
         usrp m_usrp; //!< The usrp object used to receiver frames over the air
 
@@ -100,10 +100,10 @@ namespace fun
      * It then unlocks each of the threads by posting to each block's "wake" semaphore. It then
      * waits for each thread to post that it is done with that call to its work() function.
      * Once all the threads are done it shifts the contents of each blocks output buffer to the input
-     * buffer of the next block in the chain and returns the contents of the Frame Decoder's
-     * output buffer.
+     * buffer of the next block in the chain and returns the Frame Decoder's output buffer, so
+     * the payloads reach the caller without being copied.
      */
-    std::vector<std::vector<unsigned char> > receiver_chain::process_samples(std::vector<std::complex<double> > samples)
+    const std::vector<payload_buffer> & receiver_chain::process_samples(std::vector<std::complex<double> > samples)
     {
         // samples -> sync short in
         m_frame_detector->input_buffer.swap(samples);
@@ -125,4 +125,9 @@ namespace fun
         return m_frame_decoder->output_buffer;
     }
 
+    void receiver_chain::set_frame_filter(const frame_filter & filter)
+    {
+        m_frame_decoder->set_filter(filter);
+    }
+
 }
@@ -29,8 +29,8 @@ namespace fun
      *
      *  Inputs raw complex doubles representing the base-band digitized time domain signal.
      *
-     *  Outputs vector of correctly received payloads (MPDUs) which are themselves vectors
-     *  of unsigned chars.
+     *  Outputs vector of correctly received payloads (MPDUs), each one a payload_buffer
+     *  holding the bytes.
      *
      *  The Receiver Chain class is the main controller for the blocks that are
      *  used to receive and decode PHY layer frames. It holds the instances of each block
@@ -50,10 +50,18 @@ namespace fun
          * \brief Processes the raw time domain samples.
          * \param samples A vector of received time-domain samples from the usrp block to pass to
          *  the receive chain for signal processing.
-         * \return A vector of correctly received payloads where each payload is its own vector
-         *  of unsigned chars.
+         * \return The correctly received payloads. The vector belongs to the receiver chain and is
+         *  only valid until the next call, copy the payload_buffer handles to keep payloads longer.
          */
-        std::vector<std::vector<unsigned char> > process_samples(std::vector<std::complex<double> > samples);
+        const std::vector<payload_buffer> & process_samples(std::vector<std::complex<double> > samples);
+
+        /*!
+         * \brief Sets the filter that frames have to pass to be decoded completely.
+         * \param filter The new filter, see frame_decoder::set_filter.
+         *
+         * Must not be called while #process_samples is running.
+         */
+        void set_frame_filter(const frame_filter & filter);
 
     private:
 
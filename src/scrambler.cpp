@@ -0,0 +1,151 @@
+/*! \file scrambler.cpp
+ *  \brief C++ file for the scrambler class.
+ *
+ *  The scrambler class scrambles and descrambles the DATA field and computes the CRC-32
+ *  of the payload in the same pass.
+ */
+
+#include <cstring>
+
+#include "scrambler.h"
+
+#define SCRAMBLER_PERIOD 127
+#define SCRAMBLER_SEED 93
+
+namespace fun
+{
+    /*!
+     * \brief Lookup tables of the scrambler and the CRC.
+     */
+    struct scrambler_tables
+    {
+        /*!
+         * The scrambling byte of each position, followed by a copy of the first 8 so that
+         * 8 bytes can be read from any position of the period.
+         */
+        unsigned char sequence[SCRAMBLER_PERIOD + 8];
+
+        /*!
+         * Slicing-by-8 tables of the reflected polynomial 0xEDB88320. crc[k][b] is the CRC
+         * of byte b followed by k zero bytes.
+         */
+        unsigned int crc[8][256];
+
+        scrambler_tables()
+        {
+            int state = SCRAMBLER_SEED, feedback = 0;
+            for(int x = 0; x < SCRAMBLER_PERIOD; x++)
+            {
+                feedback = (!!(state & 64)) ^ (!!(state & 8));
+                sequence[x] = feedback;
+                state = ((state << 1) & 0x7E) | feedback;
+            }
+            memcpy(&sequence[SCRAMBLER_PERIOD], &sequence[0], 8);
+
+            for(int b = 0; b < 256; b++)
+            {
+                unsigned int c = b;
+                for(int j = 0; j < 8; j++) c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+                crc[0][b] = c;
+            }
+            for(int k = 1; k < 8; k++)
+            {
+                for(int b = 0; b < 256; b++) crc[k][b] = (crc[k-1][b] >> 8) ^ crc[0][crc[k-1][b] & 0xFF];
+            }
+        }
+    };
+
+    static const scrambler_tables & get_tables()
+    {
+        static const scrambler_tables tables;
+        return tables;
+    }
+
+    /*!
+     *  Advances the (inverted) CRC register over 8 bytes, loaded little endian.
+     */
+    static inline unsigned int crc_word(const scrambler_tables & t, unsigned int c, unsigned long long w)
+    {
+        unsigned int lo = (unsigned int)w ^ c, hi = w >> 32;
+        return t.crc[7][lo & 0xFF] ^ t.crc[6][(lo >> 8) & 0xFF] ^ t.crc[5][(lo >> 16) & 0xFF] ^ t.crc[4][lo >> 24] ^
+               t.crc[3][hi & 0xFF] ^ t.crc[2][(hi >> 8) & 0xFF] ^ t.crc[1][(hi >> 16) & 0xFF] ^ t.crc[0][hi >> 24];
+    }
+
+    static inline unsigned int crc_byte(const scrambler_tables & t, unsigned int c, unsigned char b)
+    {
+        return (c >> 8) ^ t.crc[0][(c ^ b) & 0xFF];
+    }
+
+    enum crc_mode { CRC_NONE, CRC_INPUT, CRC_OUTPUT };
+
+    /*!
+     *  Works on 8 bytes at a time: the 8 scrambling bytes are a single load from the sequence
+     *  table and the CRC is advanced over the same word while it is in a register.
+     */
+    template<crc_mode MODE>
+    static unsigned int scramble_pass(const unsigned char * in, unsigned char * out, int count, int offset)
+    {
+        const scrambler_tables & t = get_tables();
+        unsigned int c = 0xFFFFFFFF;
+        int pos = offset % SCRAMBLER_PERIOD;
+
+        int x = 0;
+        for(; x + 8 <= count; x += 8)
+        {
+            unsigned long long w, s;
+            memcpy(&w, in + x, 8);
+            memcpy(&s, &t.sequence[pos], 8);
+            unsigned long long o = w ^ s;
+            memcpy(out + x, &o, 8);
+            if(MODE == CRC_INPUT) c = crc_word(t, c, w);
+            if(MODE == CRC_OUTPUT) c = crc_word(t, c, o);
+
+            pos += 8;
+            if(pos >= SCRAMBLER_PERIOD) pos -= SCRAMBLER_PERIOD;
+        }
+
+        for(; x < count; x++)
+        {
+            unsigned char w = in[x];
+            unsigned char o = w ^ t.sequence[pos];
+            out[x] = o;
+            if(MODE == CRC_INPUT) c = crc_byte(t, c, w);
+            if(MODE == CRC_OUTPUT) c = crc_byte(t, c, o);
+            if(++pos == SCRAMBLER_PERIOD) pos = 0;
+        }
+
+        return ~c;
+    }
+
+    void scrambler::scramble(const unsigned char * in, unsigned char * out, int count, int offset)
+    {
+        scramble_pass<CRC_NONE>(in, out, count, offset);
+    }
+
+    unsigned int scrambler::scramble_crc(const unsigned char * in, unsigned char * out, int count, int offset)
+    {
+        return scramble_pass<CRC_INPUT>(in, out, count, offset);
+    }
+
+    unsigned int scrambler::descramble_crc(const unsigned char * in, unsigned char * out, int count, int offset)
+    {
+        return scramble_pass<CRC_OUTPUT>(in, out, count, offset);
+    }
+
+    unsigned int scrambler::crc32(const unsigned char * data, int count, unsigned int crc)
+    {
+        const scrambler_tables & t = get_tables();
+        unsigned int c = ~crc;
+
+        int x = 0;
+        for(; x + 8 <= count; x += 8)
+        {
+            unsigned long long w;
+            memcpy(&w, data + x, 8);
+            c = crc_word(t, c, w);
+        }
+        for(; x < count; x++) c = crc_byte(t, c, data[x]);
+
+        return ~c;
+    }
+}
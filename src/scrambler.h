@@ -0,0 +1,68 @@
+/*! \file scrambler.h
+ *  \brief Header file for the scrambler class.
+ *
+ *  The scrambler class scrambles the DATA field on the transmit side, descrambles it on
+ *  the receive side and computes the CRC-32 that protects the payload. Scrambling and the
+ *  CRC are fused into a single pass over the bytes.
+ */
+
+#ifndef SCRAMBLER_H
+#define SCRAMBLER_H
+
+namespace fun
+{
+    /*!
+     * \brief The scrambler class
+     *
+     *  The scrambling sequence comes from the LFSR x^7 + x^4 + 1 seeded with 93. Each byte
+     *  of the DATA field is xor'ed with one bit of the sequence, so the sequence repeats
+     *  every 127 bytes. Since scrambling is an xor, descrambling is the same operation.
+     *
+     *  The CRC is the CRC-32 of IEEE 802.3 (identical to boost::crc_32_type) computed with
+     *  slicing-by-8. The class only contains static functions and thus doesn't need a constructor.
+     */
+    class scrambler
+    {
+    public:
+
+        /*!
+         * \brief Scrambles (or descrambles) bytes.
+         * \param in The input bytes.
+         * \param out The output bytes, may be the same as in.
+         * \param count Number of bytes.
+         * \param offset Position of the first byte in the DATA field.
+         */
+        static void scramble(const unsigned char * in, unsigned char * out, int count, int offset = 0);
+
+        /*!
+         * \brief Scrambles bytes and computes the CRC-32 of the unscrambled input.
+         * \param in The input bytes.
+         * \param out The scrambled output bytes, may be the same as in.
+         * \param count Number of bytes.
+         * \param offset Position of the first byte in the DATA field.
+         * \return The CRC-32 of in.
+         */
+        static unsigned int scramble_crc(const unsigned char * in, unsigned char * out, int count, int offset = 0);
+
+        /*!
+         * \brief Descrambles bytes and computes the CRC-32 of the descrambled output.
+         * \param in The scrambled input bytes.
+         * \param out The descrambled output bytes, may be the same as in.
+         * \param count Number of bytes.
+         * \param offset Position of the first byte in the DATA field.
+         * \return The CRC-32 of out.
+         */
+        static unsigned int descramble_crc(const unsigned char * in, unsigned char * out, int count, int offset = 0);
+
+        /*!
+         * \brief Computes the CRC-32 of bytes.
+         * \param data The bytes.
+         * \param count Number of bytes.
+         * \param crc The CRC-32 of the preceding bytes, to continue a running CRC.
+         * \return The CRC-32 of the preceding bytes and data.
+         */
+        static unsigned int crc32(const unsigned char * data, int count, unsigned int crc = 0);
+    };
+}
+
+#endif // SCRAMBLER_H
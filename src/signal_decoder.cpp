@@ -0,0 +1,287 @@
+/*! \file signal_decoder.cpp
+ *  \brief C++ file for the signal_decoder class.
+ *
+ * The signal_decoder class decodes the SIGNAL field, i.e. the PLCP header symbol, of
+ * a frame with a fixed 24 stage trellis instead of the generic Viterbi decoder.
+ */
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cstring>
+
+#include "signal_decoder.h"
+#include "cpu_features.h"
+#include "modulator.h"
+#include "parity.h"
+#include "viterbi.h"
+
+// The header is 18 data bits plus 6 tail bits, coded at rate 1/2 into one BPSK symbol
+#define SIGNAL_DATA_BITS 18
+#define SIGNAL_STAGES (SIGNAL_DATA_BITS + K - 1)
+#define SIGNAL_CODED_BITS (RATE * SIGNAL_STAGES)
+
+// Initial path metric of the states the encoder doesn't start in
+#define SIGNAL_UNREACHABLE (1 << 14)
+
+namespace fun
+{
+    /*!
+     * \brief Position of each coded bit of the header in the demodulated symbol.
+     *
+     * The 48 bit BPSK permutation of 17.3.5.6 in 802.11a-1999 moves coded bit k to
+     * 3 * (k % 16) + k / 16. The branch costs are read through this table, so the
+     * deinterleaving doesn't need a pass of its own.
+     */
+    static const unsigned char SIGNAL_DEINTERLEAVE[SIGNAL_CODED_BITS] = {
+         0,  3,  6,  9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45,
+         1,  4,  7, 10, 13, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+         2,  5,  8, 11, 14, 17, 20, 23, 26, 29, 32, 35, 38, 41, 44, 47
+    };
+
+    /*!
+     * \brief The coded bits of the trellis butterflies.
+     *
+     * A state is the last 6 input bits, so states 2i and 2i + 1 are both entered from i and
+     * from i + 32. Both polynomials use the newest and the oldest register bit, hence if the
+     * branch from i into 2i has coded bits c, the branches from i + 32 into 2i and from i into
+     * 2i + 1 have the complement of c and the branch from i + 32 into 2i + 1 has c again.
+     * The coded bits of the branch from i into 2i are kept as masks that are -1 for a 1.
+     */
+    struct signal_trellis
+    {
+        short coded[RATE][NUMSTATES/2]; //!< Coded bits of the branch from i into 2i
+
+        signal_trellis()
+        {
+            int polys[RATE] = POLYS;
+            for(int k = 0; k < RATE; k++)
+                for(int i = 0; i < NUMSTATES/2; i++)
+                    coded[k][i] = -parity((2 * i) & polys[k]);
+        }
+    };
+
+    /*
+     * The soft bits are 0 for a certain 0 and 255 for a certain 1. Relative to expecting two 0s a
+     * branch costs e = 255 - 2 * soft more for each 1 it expects, the cost of the 0s is the same
+     * for every branch of a stage and left out. Hence the branch from i into 2i costs
+     * (c0 & e0) + (c1 & e1) and its complement costs e0 + e1 minus that.
+     */
+    static inline __attribute__((always_inline)) short signal_cost(const signal_trellis & trellis, int i, const short * e)
+    {
+        return (trellis.coded[0][i] & e[0]) + (trellis.coded[1][i] & e[1]);
+    }
+
+    /*
+     * The decisions of a stage are 4 words: the even and the odd states of butterflies 0 to 15,
+     * then those of butterflies 16 to 31. Butterfly i has bit 2 * (i % 16) of its word set if
+     * state 2i resp. 2i + 1 came from i + 32, i.e. the layout of a byte mask of 16 bit lanes.
+     * Which word to read only depends on bits 0 and 5 of the state, so the traceback reads both
+     * halves and picks one instead of waiting for the state to compute an address.
+     */
+    static inline __attribute__((always_inline)) int signal_decision(const unsigned int * decisions, int state)
+    {
+        unsigned long long low = decisions[0] | (unsigned long long)decisions[1] << 32;
+        unsigned long long high = decisions[2] | (unsigned long long)decisions[3] << 32;
+        return ((state & 32 ? high : low) >> (((state & 1) << 5) | (state & 30))) & 1;
+    }
+
+    /*
+     * The path metrics stay within #SIGNAL_UNREACHABLE + 24 * 510, so 16 bits are enough and they
+     * never need renormalizing.
+     */
+    static void signal_acs_generic(const short * e, const signal_trellis & trellis, unsigned int (*decisions)[4], short * final_metrics)
+    {
+        short metrics[2][NUMSTATES];
+        for(int s = 0; s < NUMSTATES; s++) metrics[0][s] = s == 0 ? 0 : SIGNAL_UNREACHABLE;
+
+        for(int t = 0; t < SIGNAL_STAGES; t++)
+        {
+            const short * old_metrics = metrics[t & 1];
+            short * new_metrics = metrics[(t + 1) & 1];
+            const short * stage_e = &e[RATE*t];
+            unsigned char even[NUMSTATES/2], odd[NUMSTATES/2];
+
+            for(int i = 0; i < NUMSTATES/2; i++)
+            {
+                short c = signal_cost(trellis, i, stage_e);
+                short cc = stage_e[0] + stage_e[1] - c;
+                short a0 = old_metrics[i] + c, b0 = old_metrics[i + NUMSTATES/2] + cc;
+                short a1 = old_metrics[i] + cc, b1 = old_metrics[i + NUMSTATES/2] + c;
+                new_metrics[2*i] = b0 < a0 ? b0 : a0;
+                new_metrics[2*i+1] = b1 < a1 ? b1 : a1;
+                even[i] = b0 < a0;
+                odd[i] = b1 < a1;
+            }
+
+            unsigned int * d = decisions[t];
+            d[0] = d[1] = d[2] = d[3] = 0;
+            for(int i = 0; i < NUMSTATES/2; i++)
+            {
+                d[2 * (i >> 4)] |= even[i] << (2 * (i & 15));
+                d[2 * (i >> 4) + 1] |= odd[i] << (2 * (i & 15));
+            }
+        }
+        memcpy(final_metrics, metrics[SIGNAL_STAGES & 1], sizeof(metrics[0]));
+    }
+
+    /*
+     * The 64 path metrics stay in eight registers across the stages, register r holds states 8r
+     * to 8r + 7. The butterflies of m[r] / m[r + 4] give the even and odd states of m[2r] and
+     * m[2r + 1], which the unpacks interleave back into order.
+     */
+    static void signal_acs_sse2(const short * e, const signal_trellis & trellis, unsigned int (*decisions)[4], short * final_metrics)
+    {
+        __m128i m[8];
+        m[0] = _mm_set_epi16(SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE,
+                             SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, 0);
+        for(int r = 1; r < 8; r++) m[r] = _mm_set1_epi16(SIGNAL_UNREACHABLE);
+        __m128i first[4], second[4];
+        for(int r = 0; r < 4; r++)
+        {
+            first[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&trellis.coded[0][8*r]));
+            second[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&trellis.coded[1][8*r]));
+        }
+
+        for(int t = 0; t < SIGNAL_STAGES; t++)
+        {
+            __m128i e0 = _mm_set1_epi16(e[RATE*t]);
+            __m128i e1 = _mm_set1_epi16(e[RATE*t+1]);
+            __m128i sum = _mm_add_epi16(e0, e1);
+            __m128i next[8];
+            unsigned int even[4], odd[4];
+
+            for(int r = 0; r < 4; r++)
+            {
+                __m128i c = _mm_add_epi16(_mm_and_si128(first[r], e0), _mm_and_si128(second[r], e1));
+                __m128i cc = _mm_sub_epi16(sum, c);
+                __m128i a0 = _mm_add_epi16(m[r], c), b0 = _mm_add_epi16(m[r + 4], cc);
+                __m128i a1 = _mm_add_epi16(m[r], cc), b1 = _mm_add_epi16(m[r + 4], c);
+                even[r] = _mm_movemask_epi8(_mm_cmpgt_epi16(a0, b0));
+                odd[r] = _mm_movemask_epi8(_mm_cmpgt_epi16(a1, b1));
+                __m128i even_metrics = _mm_min_epi16(a0, b0), odd_metrics = _mm_min_epi16(a1, b1);
+                next[2*r] = _mm_unpacklo_epi16(even_metrics, odd_metrics);
+                next[2*r+1] = _mm_unpackhi_epi16(even_metrics, odd_metrics);
+            }
+
+            decisions[t][0] = even[0] | even[1] << 16;
+            decisions[t][1] = odd[0] | odd[1] << 16;
+            decisions[t][2] = even[2] | even[3] << 16;
+            decisions[t][3] = odd[2] | odd[3] << 16;
+            for(int r = 0; r < 8; r++) m[r] = next[r];
+        }
+        for(int r = 0; r < 8; r++) _mm_storeu_si128(reinterpret_cast<__m128i *>(&final_metrics[8*r]), m[r]);
+    }
+
+    /*
+     * Same as signal_acs_sse2 with 256 bit registers, register r holds states 16r
+     * to 16r + 15. The butterflies of m0 / m2 give the even and odd states of m0 and m1, those of
+     * m1 / m3 the ones of m2 and m3. The unpacks only interleave within 128 bit lanes, so lane
+     * permutes put them back in order.
+     */
+    __attribute__((target("avx2")))
+    static void signal_acs_avx2(const short * e, const signal_trellis & trellis, unsigned int (*decisions)[4], short * final_metrics)
+    {
+        __m256i m0 = _mm256_set_epi16(SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE,
+                                      SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE,
+                                      SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE,
+                                      SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, SIGNAL_UNREACHABLE, 0);
+        __m256i m1 = _mm256_set1_epi16(SIGNAL_UNREACHABLE);
+        __m256i m2 = m1, m3 = m1;
+        const __m256i first0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&trellis.coded[0][0]));
+        const __m256i first1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&trellis.coded[0][16]));
+        const __m256i second0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&trellis.coded[1][0]));
+        const __m256i second1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&trellis.coded[1][16]));
+
+        for(int t = 0; t < SIGNAL_STAGES; t++)
+        {
+            __m256i e0 = _mm256_set1_epi16(e[RATE*t]);
+            __m256i e1 = _mm256_set1_epi16(e[RATE*t+1]);
+            __m256i sum = _mm256_add_epi16(e0, e1);
+
+            __m256i c0 = _mm256_add_epi16(_mm256_and_si256(first0, e0), _mm256_and_si256(second0, e1));
+            __m256i c1 = _mm256_add_epi16(_mm256_and_si256(first1, e0), _mm256_and_si256(second1, e1));
+            __m256i cc0 = _mm256_sub_epi16(sum, c0);
+            __m256i cc1 = _mm256_sub_epi16(sum, c1);
+
+            __m256i a0 = _mm256_add_epi16(m0, c0), b0 = _mm256_add_epi16(m2, cc0);
+            __m256i a1 = _mm256_add_epi16(m0, cc0), b1 = _mm256_add_epi16(m2, c0);
+            __m256i a2 = _mm256_add_epi16(m1, c1), b2 = _mm256_add_epi16(m3, cc1);
+            __m256i a3 = _mm256_add_epi16(m1, cc1), b3 = _mm256_add_epi16(m3, c1);
+
+            decisions[t][0] = _mm256_movemask_epi8(_mm256_cmpgt_epi16(a0, b0));
+            decisions[t][1] = _mm256_movemask_epi8(_mm256_cmpgt_epi16(a1, b1));
+            decisions[t][2] = _mm256_movemask_epi8(_mm256_cmpgt_epi16(a2, b2));
+            decisions[t][3] = _mm256_movemask_epi8(_mm256_cmpgt_epi16(a3, b3));
+
+            __m256i even0 = _mm256_min_epi16(a0, b0), odd0 = _mm256_min_epi16(a1, b1);
+            __m256i even1 = _mm256_min_epi16(a2, b2), odd1 = _mm256_min_epi16(a3, b3);
+            __m256i lo0 = _mm256_unpacklo_epi16(even0, odd0), hi0 = _mm256_unpackhi_epi16(even0, odd0);
+            __m256i lo1 = _mm256_unpacklo_epi16(even1, odd1), hi1 = _mm256_unpackhi_epi16(even1, odd1);
+            m0 = _mm256_permute2x128_si256(lo0, hi0, 0x20);
+            m1 = _mm256_permute2x128_si256(lo0, hi0, 0x31);
+            m2 = _mm256_permute2x128_si256(lo1, hi1, 0x20);
+            m3 = _mm256_permute2x128_si256(lo1, hi1, 0x31);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&final_metrics[0]), m0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&final_metrics[16]), m1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&final_metrics[32]), m2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&final_metrics[48]), m3);
+    }
+
+    /*!
+     * The encoder starts and ends in state 0, so the header is the best path into state 0 after
+     * the last stage. Everything lives on the stack: the soft bits, the branch costs in coded bit
+     * order and 4 decision words per stage. Besides the parity and the rate field a header has
+     * to have its reserved bit clear and its tail has to decode to zeros, i.e. no path may end
+     * in another state with a better metric than state 0. Noise that happens to trigger
+     * START_OF_FRAME rarely passes all of them.
+     */
+    bool signal_decoder::decode(const std::complex<double> * samples, const float * csi, plcp_header & header)
+    {
+        typedef void (*acs_kernel)(const short *, const signal_trellis &, unsigned int (*)[4], short *);
+        static const acs_kernel kernels[ARCH_COUNT] = { &signal_acs_generic, &signal_acs_sse2, &signal_acs_avx2, nullptr };
+        static const signal_trellis trellis;
+
+        // Demodulate the header and deinterleave it into branch costs
+        unsigned char soft[SIGNAL_CODED_BITS];
+        if(csi) modulator::demodulate(samples, csi, soft, SIGNAL_CODED_BITS, RATE_1_2_BPSK);
+        else modulator::demodulate(samples, soft, SIGNAL_CODED_BITS, RATE_1_2_BPSK);
+
+        short e[SIGNAL_CODED_BITS];
+        for(int k = 0; k < SIGNAL_CODED_BITS; k++) e[k] = 255 - 2 * soft[SIGNAL_DEINTERLEAVE[k]];
+
+        unsigned int decisions[SIGNAL_STAGES][4];
+        short metrics[NUMSTATES];
+        cpu_features::select(kernels)(e, trellis, decisions, metrics);
+
+        // The tail bits are zero, so the most likely path has to end in state 0. Otherwise the
+        // tail didn't decode to zeros and the symbol most likely isn't a header at all.
+        if(*std::min_element(metrics, metrics + NUMSTATES) < metrics[0]) return false;
+
+        // Trace back from state 0, the input bit of each stage is the lowest bit of the state it enters
+        unsigned int header_field = 0;
+        int state = 0;
+        for(int t = SIGNAL_STAGES - 1; t >= 0; t--)
+        {
+            header_field |= (state & 1) << (23 - t);
+            state = (state >> 1) | (signal_decision(decisions[t], state) << (K - 2));
+        }
+        header_field &= ~0x3Fu; // tail bits, zero since the traceback starts in state 0
+
+        // Verify header parity and that the reserved bit is clear
+        if(parity(header_field) == 1) return false;
+        if(header_field & (1 << 18)) return false;
+
+        // Get the rate field and length, and check for a valid rate
+        unsigned char rate_field = ((header_field >> 19) & 0xF);
+        int length = ((header_field >> 6) & 0xFFF);
+        if(!RateParams::IsValidRateField(rate_field)) return false;
+
+        // Populate the header fields
+        RateParams rate_params = RateParams::FromRateField(rate_field);
+        header.rate = rate_params.rate;
+        header.length = length;
+        header.num_symbols = (16 /* service */ + 8 * (length + 4 /* CRC */) + 6 /* tail */ + rate_params.dbps - 1) / rate_params.dbps;
+        return true;
+    }
+}
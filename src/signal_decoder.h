@@ -0,0 +1,43 @@
+/*! \file signal_decoder.h
+ *  \brief Header file for the signal_decoder class.
+ *
+ * The signal_decoder class decodes the SIGNAL field, i.e. the PLCP header symbol, of
+ * a frame. The header is always a single rate 1/2 BPSK symbol carrying 18 data bits and
+ * 6 tail bits, so instead of going through the generic Viterbi decoder it is decoded with
+ * a fixed 24 stage trellis that lives on the stack.
+ */
+
+#ifndef SIGNAL_DECODER_H
+#define SIGNAL_DECODER_H
+
+#include <complex>
+
+#include "ppdu.h"
+
+namespace fun
+{
+    /*!
+     * \brief The signal_decoder class
+     *
+     * The signal_decoder class contains only static functions and thus doesn't need a
+     * constructor. Decoding a header doesn't allocate any memory: the soft bits, the path
+     * metrics and the 24 decision words of the trellis are all local arrays, and the
+     * deinterleaving is folded into the trellis through a precomputed table.
+     */
+    class signal_decoder
+    {
+    public:
+
+        /*!
+         * \brief Decodes a SIGNAL field.
+         * \param samples The 48 complex samples of the header symbol.
+         * \param csi Optional per-subcarrier SNR of the samples, see modulator::demodulate.
+         * \param header Output for the rate, length and number of symbols of the frame.
+         *  Only written to if the header is valid.
+         * \return Whether the header passed the parity check and has a valid rate field.
+         */
+        static bool decode(const std::complex<double> * samples, const float * csi, plcp_header & header);
+    };
+}
+
+#endif // SIGNAL_DECODER_H
@@ -28,6 +28,14 @@ namespace fun
         1, 2, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
     };
 
+    const unsigned char symbol_mapper::DATA_SUBCARRIERS[48] =
+    {
+         6,  7,  8,  9, 10, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 26, 27, 28, 29, 30, 31,
+        33, 34, 35, 36, 37, 38, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 54, 55, 56, 57, 58
+    };
+
+    const unsigned char symbol_mapper::PILOT_SUBCARRIERS[4] = { 11, 25, 39, 53 };
+
     /*!
      *  The polarity sequence that is multiplied by the pilot sample for each OFDM symbol beginning
      *  with the signal symbol. For example, the pilots in the signal symbol will all be multipled by
@@ -141,6 +149,38 @@ namespace fun
         return data_samples;
     }
 
+    void symbol_mapper::map_pilots(std::complex<double> * symbols, int symbol_count, int first_symbol)
+    {
+        static const pilot_templates templates;
+        map_pilots(symbols, symbol_count, first_symbol, templates);
+    }
+
+    symbol_mapper::pilot_templates::pilot_templates(double scale)
+    {
+        for(int x = 0; x < 127; x++)
+            for(int p = 0; p < 4; p++)
+                pilots[x][p] = PILOTS[p] * POLARITY[x] * scale;
+    }
+
+    /*!
+     *  The null subcarriers are the 6 lowest, the DC and the 5 highest.
+     */
+    void symbol_mapper::map_pilots(std::complex<double> * symbols, int symbol_count, int first_symbol, const pilot_templates & templates)
+    {
+        int index = first_symbol % 127;
+        for(int x = 0; x < symbol_count; x++)
+        {
+            std::complex<double> * symbol = &symbols[x * 64];
+            for(int s = 0; s < 6; s++) symbol[s] = 0;
+            symbol[32] = 0;
+            for(int s = 59; s < 64; s++) symbol[s] = 0;
+
+            const std::complex<double> * pilots = templates.pilots[index];
+            for(int p = 0; p < 4; p++) symbol[PILOT_SUBCARRIERS[p]] = pilots[p];
+            if(++index == 127) index = 0;
+        }
+    }
+
     // Get the active subcarrier map
     std::vector<unsigned char> symbol_mapper::get_active_map()
     {
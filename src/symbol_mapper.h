@@ -51,6 +51,45 @@ namespace fun
          */
         std::vector<unsigned char> get_active_map();
 
+        /*!
+         * \brief Writes the pilots and nulls of symbols whose data subcarriers are already filled in.
+         * \param symbols The symbols, 64 subcarriers each in the same order as the output of #map.
+         * \param symbol_count Number of symbols.
+         * \param first_symbol Index of the first symbol in the frame (the SIGNAL symbol is 0), which
+         *  selects the pilot polarity.
+         *
+         * Together with modulator::modulate_subcarriers this builds the same symbols as #map without
+         * an intermediate buffer.
+         */
+        static void map_pilots(std::complex<double> * symbols, int symbol_count, int first_symbol = 0);
+
+        /*!
+         * \brief The pilots of every symbol index with the polarity and a scale already applied.
+         */
+        struct pilot_templates
+        {
+            std::complex<double> pilots[127][4]; //!< Pilots of the symbols whose index modulo 127 is the first index
+
+            /*!
+             * \brief Constructor for pilot_templates
+             * \param scale Factor for the pilots, the same as the one for the data subcarriers.
+             */
+            explicit pilot_templates(double scale = 1.0);
+        };
+
+        /*!
+         * \brief Same as map_pilots(std::complex<double> *, int, int) with precomputed pilots.
+         * \param symbols The symbols, 64 subcarriers each in the same order as the output of #map.
+         * \param symbol_count Number of symbols.
+         * \param first_symbol Index of the first symbol in the frame (the SIGNAL symbol is 0).
+         * \param templates The pilots to write.
+         */
+        static void map_pilots(std::complex<double> * symbols, int symbol_count, int first_symbol, const pilot_templates & templates);
+
+        static const unsigned char DATA_SUBCARRIERS[48]; //!< Subcarrier of each data sample in a symbol
+
+        static const unsigned char PILOT_SUBCARRIERS[4]; //!< Subcarrier of each pilot in a symbol
+
     private:
 
         static const std::vector<unsigned char> m_active_map; //!< The current map of data, pilots, and nulls.
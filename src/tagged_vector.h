@@ -74,6 +74,29 @@ namespace fun
         }
     };
 
+    /*! \brief tagged_csi_vector struct
+     *
+     * A tagged_vector of equalized frequency domain samples together with the channel
+     * state of each sample, for the soft demapper.
+     */
+    template<int N>
+    struct tagged_csi_vector : public tagged_vector<N>
+    {
+        /*!
+         * \brief Channel state of each sample: |H|^2 divided by the noise power, i.e. the
+         * SNR of that subcarrier. 0 for null subcarriers.
+         */
+        float csi[N];
+
+        /*!
+         * \brief Non-initializing constructor for tagged_csi_vector.
+         *
+         * Does not initialize the elements of #samples or #csi to anything.
+         * \param _tag optional initial #tag value. Default is #NONE if left out.
+         */
+        tagged_csi_vector(vector_tag _tag = NONE) : tagged_vector<N>(_tag) {}
+    };
+
     /*!
      * \brief The tagged_sample struct
      *
@@ -14,6 +14,7 @@
 #include <iostream>
 
 #include "preamble.h"
+#include "dsp_kernels.h"
 
 namespace fun
 {
@@ -74,13 +75,9 @@ namespace fun
                 std::vector<std::pair<double, int> > peaks;
                 for(int p = x; p < x + CARRYOVER_LENGTH - LTS_LENGTH; p++)
                 {
-                    std::complex<double> corr(0, 0);
-                    double power = 0;
-                    for(int s = 0; s < 64; s++)
-                    {
-                        corr += input[p+s].sample * LTS_TIME_DOMAIN_CONJ[s] /* complex conjugate of LTS */;
-                        power += std::norm(input[p+s].sample);
-                    }
+                    std::complex<double> corr;
+                    double power;
+                    dsp_kernels::correlate(&input[p], LTS_TIME_DOMAIN_CONJ /* complex conjugate of LTS */, 64, corr, power);
                     double corr_norm = std::abs(corr) / power;
                     if(corr_norm > LTS_CORR_THRESHOLD) peaks.push_back(std::pair<double, int>(corr_norm, p));
                 }
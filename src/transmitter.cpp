@@ -7,34 +7,190 @@
 
 #include "transmitter.h"
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
 
 namespace fun {
 
+    /*!
+     *  The frame builder scales the frames by tx_amp as it builds them, so the usrp doesn't have to.
+     */
+    static usrp_params unscaled(usrp_params params)
+    {
+        params.tx_amp = 1.0;
+        return params;
+    }
+
+    /*!
+     *  Raises a maximum counter to value if it is lower.
+     */
+    template<typename T>
+    static void raise_max(std::atomic<T> & max, T value)
+    {
+        T current = max.load(std::memory_order_relaxed);
+        while(current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
     /*!
      *  This constructor shows exactly what parameters need to be set for the transmitter
      */
-    transmitter::transmitter(double freq, double samp_rate, double tx_gain, double tx_amp, std::string device_addr) :
-        m_usrp(usrp_params(freq, samp_rate, tx_gain, 20, tx_amp, device_addr)),
-        m_frame_builder()
+    transmitter::transmitter(double freq, double samp_rate, double tx_gain, double tx_amp, std::string device_addr, int encode_threads) :
+        m_usrp(usrp_params(freq, samp_rate, tx_gain, 20, 1.0, device_addr)),
+        m_order(TX_QUEUE_SIZE),
+        m_queue(TX_QUEUE_SIZE + 1)
     {
+        start(tx_amp, encode_threads);
     }
 
     /*!
      * This construct is for those who feel more comfortable using the usrp_params struct
      */
-    transmitter::transmitter(usrp_params params) :
-        m_usrp(params),
-        m_frame_builder()
+    transmitter::transmitter(usrp_params params, int encode_threads) :
+        m_usrp(unscaled(params)),
+        m_order(TX_QUEUE_SIZE),
+        m_queue(TX_QUEUE_SIZE + 1)
     {
+        start(params.tx_amp, encode_threads);
     }
 
     /*!
-     *  Transmits a single frame, blocking until the frame is sent.
+     *  The null requests end up behind every frame queued before them, so all of those are
+     *  sent before the threads exit.
+     */
+    transmitter::~transmitter()
+    {
+        m_order.push(NULL);
+        for(size_t x = 0; x < m_encode_threads.size(); x++) m_queue.push(NULL);
+        for(size_t x = 0; x < m_encode_threads.size(); x++) m_encode_threads[x].join();
+        m_transmit_thread.join();
+    }
+
+    /*!
+     *  The frame builders, and the FFTW plans in them, are all created here on the calling thread
+     *  because creating FFTW plans isn't thread safe. They share the default waveform cache budget
+     *  so that the cache doesn't grow with the number of threads.
+     */
+    void transmitter::start(double amplitude, int encode_threads)
+    {
+        m_frames_sent = 0;
+        m_encode_time_ns = 0;
+        m_max_encode_time_ns = 0;
+        m_producer_stalls = 0;
+        m_queue_depth = 0;
+        m_max_queue_depth = 0;
+
+        if(encode_threads <= 0) encode_threads = std::max(1u, std::thread::hardware_concurrency());
+        for(int x = 0; x < encode_threads; x++)
+        {
+            m_frame_builders.push_back(std::unique_ptr<frame_builder>(new frame_builder(amplitude)));
+            m_frame_builders[x]->set_cache_size(FRAME_CACHE_DEFAULT_SIZE / encode_threads);
+        }
+
+        for(int x = 0; x < encode_threads; x++)
+            m_encode_threads.push_back(std::thread(&transmitter::encode_loop, this, m_frame_builders[x].get()));
+        m_transmit_thread = std::thread(&transmitter::transmit_loop, this);
+    }
+
+    /*!
+     *  Transmits a single frame, blocking until the frame is sent. The frame goes through the
+     *  transmit queue like the asynchronous ones so that it keeps its place among them.
      */
     void transmitter::send_frame(std::vector<unsigned char> payload, Rate phy_rate)
     {
-        std::vector<std::complex<double> > samples = m_frame_builder.build_frame(payload, phy_rate);
-        m_usrp.send_burst_sync(samples);
+        send_frame_async(std::move(payload), phy_rate).wait();
+    }
+
+    std::future<void> transmitter::send_frame_async(std::vector<unsigned char> payload, Rate phy_rate)
+    {
+        tx_request * request = new tx_request();
+        request->payload = std::move(payload);
+        request->rate = phy_rate;
+        std::future<void> future = request->done.get_future();
+        enqueue(request);
+        return future;
+    }
+
+    void transmitter::send_frame_async(std::vector<unsigned char> payload, Rate phy_rate, std::function<void()> callback)
+    {
+        tx_request * request = new tx_request();
+        request->payload = std::move(payload);
+        request->rate = phy_rate;
+        request->callback = std::move(callback);
+        enqueue(request);
+    }
+
+    transmitter_stats transmitter::get_stats() const
+    {
+        transmitter_stats stats;
+        stats.frames_sent = m_frames_sent;
+        stats.encode_time_ns = m_encode_time_ns;
+        stats.max_encode_time_ns = m_max_encode_time_ns;
+        stats.producer_stalls = m_producer_stalls;
+        stats.queue_depth = m_queue_depth;
+        stats.max_queue_depth = m_max_queue_depth;
+        return stats;
+    }
+
+    /*!
+     *  #m_order holds every frame in flight, so it is the one that blocks the caller once the
+     *  radio falls behind. A request only goes into #m_queue after it has a place in #m_order,
+     *  which is why #m_queue never fills up: it holds at most the #TX_QUEUE_SIZE requests in
+     *  #m_order plus the one the transmit thread is waiting on.
+     */
+    void transmitter::enqueue(tx_request * request)
+    {
+        if(!m_order.try_push(request))
+        {
+            m_producer_stalls++;
+            m_order.push(request);
+        }
+        raise_max(m_max_queue_depth, ++m_queue_depth);
+        m_queue.push(request);
+    }
+
+    /*!
+     *  The encode threads take the frames in whatever order they come and may finish them out of
+     *  order, the transmit thread puts them back in order.
+     */
+    void transmitter::encode_loop(frame_builder * builder)
+    {
+        while(true)
+        {
+            tx_request * request = m_queue.pop();
+            if(request == NULL) return;
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            request->samples = builder->build_frame(request->payload, request->rate);
+            unsigned long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            m_encode_time_ns += elapsed;
+            raise_max(m_max_encode_time_ns, elapsed);
+
+            request->payload.clear();
+            sem_post(&request->encoded);
+        }
+    }
+
+    /*!
+     *  Waits for each frame in #m_order to be built before sending it, the encode threads keep
+     *  building the frames behind it in the meantime.
+     */
+    void transmitter::transmit_loop()
+    {
+        while(true)
+        {
+            tx_request * request = m_order.pop();
+            if(request == NULL) return;
+
+            while(sem_wait(&request->encoded) != 0 && errno == EINTR);
+            m_usrp.send_burst_sync(std::move(request->samples));
+
+            m_frames_sent++;
+            m_queue_depth--;
+            if(request->callback) request->callback();
+            else request->done.set_value();
+            delete request;
+        }
     }
 
 }
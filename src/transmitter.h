@@ -10,12 +10,38 @@
 #define TRANSMITTER_H
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <semaphore.h>
 #include "usrp.h"
 #include "rates.h"
 #include "frame_builder.h"
+#include "mpmc_queue.h"
+
+/*!
+ * \brief Number of frames that can be queued or encoded behind the one on the air before
+ *  send_frame_async() blocks.
+ */
+#define TX_QUEUE_SIZE 64
 
 namespace fun {
 
+    /*!
+     * \brief Counters of the transmit pipeline, see transmitter::get_stats().
+     */
+    struct transmitter_stats
+    {
+        unsigned long long frames_sent;        //!< Number of frames that are done transmitting
+        unsigned long long encode_time_ns;     //!< Total time the encode threads spent building frames
+        unsigned long long max_encode_time_ns; //!< Longest time spent building a single frame
+        unsigned long long producer_stalls;    //!< Number of send_frame_async() calls that blocked on a full queue
+        int queue_depth;                       //!< Number of frames queued, being encoded or waiting for the radio
+        int max_queue_depth;                   //!< Highest queue_depth so far
+    };
+
     /*!
      * \brief The transmitter class is the public interface for the fun_ofdm transmit chain.
      *  This is the easiest way to start transmitting 802.11a OFDM frames out of the box.
@@ -24,6 +50,15 @@ namespace fun {
      *  sample rate, transmitter gain, and amplitude). Then to send a packet simply call
      *  the transmitter::send_frame() function passing it the desired packet to be transmitted
      *  and the desired Physical Layer rate (PHY Rate) to transmit it.
+     *
+     *  Frames can also be queued with transmitter::send_frame_async(), which returns as soon as the
+     *  frame is in the transmit queue. Internally a pool of encode threads builds the queued
+     *  frames, each with its own frame_builder and an equal share of the default waveform cache
+     *  budget, while the transmit thread has the previous frame on the air. The transmit thread
+     *  sends the frames in the order they were queued in, no matter which encode thread finishes
+     *  first. Any number of threads may queue frames at the same time. Once #TX_QUEUE_SIZE frames
+     *  are in flight, because the radio can't keep up, queueing another one blocks until the oldest
+     *  is sent.
      */
     class transmitter
     {
@@ -36,6 +71,7 @@ namespace fun {
          * \param tx_gain [Optional] Transmit Gain
          * \param tx_amp [Optional] Transmit Amplitude
          * \param device_addr [Optional] IP address of USRP device
+         * \param encode_threads [Optional] Number of threads that build frames, 0 for one per hardware thread
          *
          *  Defaults to:
          *  - center_freq -> 5.72e9 (5.72 GHz)
@@ -43,14 +79,16 @@ namespace fun {
          *  - tx_gain -> 20
          *  - device_addr -> "" (empty string will default to letting the UHD api
          *    automatically find an available USRP)
+         *  - encode_threads -> 1
          *  - *Note:
          *     + rx_gain -> 20 even though it is irrelevant for the transmitter
          */
-        transmitter(double freq = 5.72e9, double samp_rate = 5e6, double tx_gain = 20, double tx_amp=1.0, std::string device_addr="");
+        transmitter(double freq = 5.72e9, double samp_rate = 5e6, double tx_gain = 20, double tx_amp=1.0, std::string device_addr="", int encode_threads = 1);
 
         /*!
          * \brief Constructor for the transmitter that uses the usrp_params struct
          * \param params [Optional] The usrp parameters you want to use for this transmitter
+         * \param encode_threads [Optional] Number of threads that build frames, 0 for one per hardware thread
          *
          *  Defaults to:
          *  - center freq -> 5.72e9 (5.72 GHz)
@@ -59,8 +97,9 @@ namespace fun {
          *  - rx gain -> 20 (although this is irrelevant for the transmitter)
          *  - device ip address -> "" (empty string will default to letting the UHD api
          *    automatically find an available USRP)
+         *  - encode threads -> 1
          */
-        transmitter(usrp_params params = usrp_params());
+        transmitter(usrp_params params = usrp_params(), int encode_threads = 1);
 
         /*!
          * \brief Send a single PHY frame at the given PHY Rate
@@ -72,11 +111,103 @@ namespace fun {
          */
         void send_frame(std::vector<unsigned char> payload, Rate phy_rate = RATE_1_2_BPSK);
 
+        /*!
+         * \brief Queue a single PHY frame for transmission at the given PHY Rate
+         * \param payload The data to be transmitted (i.e. the MPDU)
+         * \param phy_rate [Optional] The PHY data rate to transmit at - defaults to 1/2 BPSK
+         * \return A future that becomes ready once the frame is done transmitting.
+         *
+         *  Only blocks if #TX_QUEUE_SIZE frames are already in flight.
+         */
+        std::future<void> send_frame_async(std::vector<unsigned char> payload, Rate phy_rate = RATE_1_2_BPSK);
+
+        /*!
+         * \brief Queue a single PHY frame for transmission at the given PHY Rate
+         * \param payload The data to be transmitted (i.e. the MPDU)
+         * \param phy_rate The PHY data rate to transmit at
+         * \param callback Called once the frame is done transmitting. It runs in the transmit
+         *  thread, so it should return quickly to keep the next frame from waiting.
+         *
+         *  Only blocks if #TX_QUEUE_SIZE frames are already in flight.
+         */
+        void send_frame_async(std::vector<unsigned char> payload, Rate phy_rate, std::function<void()> callback);
+
+        /*!
+         * \brief Gets the counters of the transmit pipeline.
+         *
+         *  The counters are read one at a time while the threads keep running, so they are only
+         *  consistent with each other once the transmitter is idle.
+         */
+        transmitter_stats get_stats() const;
+
+        /*!
+         * \brief Destructor for the transmitter
+         *
+         *  Sends the frames that are still queued and stops the encode and transmit threads.
+         */
+        ~transmitter();
+
     private:
 
+        /*!
+         * \brief A queued frame on its way through the encode and transmit threads.
+         */
+        struct tx_request
+        {
+            tx_request() { sem_init(&encoded, 0, 0); }
+            ~tx_request() { sem_destroy(&encoded); }
+
+            std::vector<unsigned char> payload;           //!< The data to be transmitted
+            Rate rate;                                    //!< The PHY rate to transmit at
+            std::vector<std::complex<double> > samples;   //!< The frame, filled in by an encode thread
+            sem_t encoded;                                //!< Posted once #samples is ready
+            std::promise<void> done;                      //!< Set once the frame is sent if there is no callback
+            std::function<void()> callback;               //!< Called once the frame is sent
+        };
+
+        /*!
+         * \brief Creates the frame builders and starts the encode and transmit threads.
+         */
+        void start(double amplitude, int encode_threads);
+
+        /*!
+         * \brief Queues a request, blocking while the queue is full.
+         */
+        void enqueue(tx_request * request);
+
+        /*!
+         * \brief Builds queued frames with one of the frame builders.
+         */
+        void encode_loop(frame_builder * builder);
+
+        /*!
+         * \brief Sends the built frames in order and signals their completion.
+         */
+        void transmit_loop();
+
         usrp m_usrp; //!< The usrp object used to send the generated frames over the air
 
-        frame_builder m_frame_builder; //!< The frame builder object used to generate the frames
+        std::vector<std::unique_ptr<frame_builder> > m_frame_builders; //!< One frame builder per encode thread
+
+        mpmc_queue<tx_request *> m_order; //!< Frames in flight in the order they are sent in, a null request stops the transmit thread
+
+        mpmc_queue<tx_request *> m_queue; //!< Frames waiting to be built, a null request stops one encode thread
+
+        std::vector<std::thread> m_encode_threads; //!< The threads that build the frames
+
+        std::thread m_transmit_thread; //!< The thread that sends the frames
+
+        std::atomic<unsigned long long> m_frames_sent; //!< See transmitter_stats
+
+        std::atomic<unsigned long long> m_encode_time_ns; //!< See transmitter_stats
+
+        std::atomic<unsigned long long> m_max_encode_time_ns; //!< See transmitter_stats
+
+        std::atomic<unsigned long long> m_producer_stalls; //!< See transmitter_stats
+
+        std::atomic<int> m_queue_depth; //!< See transmitter_stats
+
+        std::atomic<int> m_max_queue_depth; //!< See transmitter_stats
 
     };
 
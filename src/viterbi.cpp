@@ -17,48 +17,455 @@
 #include <emmintrin.h>
 #include <xmmintrin.h>
 #include <mmintrin.h>
+#include <immintrin.h>
 
 #include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <semaphore.h>
 
 #include "parity.h"
+#include "cpu_features.h"
 
 namespace fun
 {
 
     /*!
-     *  Main decode function.
+     * -Initializations
+     *  + #Branchtab -> expected symbols for each state and polynomial
+     *  + #m_vp -> NULL until the first decode
+     *  + #m_max_bits -> 0
+     *  + #m_batch_mem -> NULL until the first batch decode
+     */
+    viterbi::viterbi() :
+        m_vp(NULL),
+        m_max_bits(0),
+        m_batch_mem(NULL),
+        m_batch_size(0),
+        m_tb_depth(0),
+        m_stream_cap(0),
+        m_stages(0),
+        m_emitted(0),
+        m_npending(0)
+    {
+      int polys[RATE] = POLYS;
+      for (int state=0;state < NUMSTATES/2;state++) {
+        for (int i=0; i<RATE; i++) {
+          Branchtab[i*NUMSTATES/2+state] = (polys[i] < 0) ^ parity((2*state) & abs(polys[i])) ? 255 : 0;
+        }
+      }
+    }
+
+    viterbi::~viterbi()
+    {
+      if (m_vp != NULL) {
+        free(m_vp->decisions);
+        free(m_vp);
+      }
+      free(m_batch_mem);
+    }
+
+    /*!
+     *  Main decode function. Reuses the decoder state from previous calls.
      */
     void viterbi::conv_decode(unsigned char * symbols, unsigned char * data, int data_bits)
     {
-      struct v * vp = viterbi_alloc(data_bits);
-      viterbi_init(vp, 0);
+      struct v * vp = viterbi_reserve(data_bits);
+      if (vp == NULL) return;
       viterbi_decode(vp, &symbols[0], &data[0], data_bits);
-      viterbi_free(vp);
     }
 
+    /*!
+     *  The kernels read the punctured symbols directly, see punct_2_3 and punct_3_4.
+     */
+    void viterbi::conv_decode(const unsigned char * symbols, unsigned char * data, int data_bits, puncturing pattern)
+    {
+      struct v * vp = viterbi_reserve(data_bits);
+      if (vp == NULL) return;
+      viterbi_decode(vp, symbols, data, data_bits, pattern);
+    }
+
+    /*!
+     *  The blocks are sorted by length and decoded in groups of as many blocks as the widest
+     *  batch kernel has lanes. A smaller group uses the narrowest kernel it fits in, and goes
+     *  through #conv_decode if it would leave more than half of the lanes idle.
+     */
+    void viterbi::conv_decode_batch(unsigned char * const * symbols, unsigned char * const * data, const int * data_bits, int count)
+    {
+      static const struct { batch_kernel kernel; int lanes; } kernels[ARCH_COUNT] = {
+          { nullptr, 0 },                // ARCH_GENERIC
+          { &viterbi::BATCH_SSE2, 16 },  // ARCH_SSE2
+          { &viterbi::BATCH_AVX2, 32 },  // ARCH_AVX2
+          { &viterbi::BATCH_AVX512, 64 } // ARCH_AVX512
+      };
+      int arch = cpu_features::active();
+
+      std::vector<int> order(count);
+      for (int f = 0; f < count; f++) order[f] = f;
+      std::sort(order.begin(), order.end(), [data_bits](int a, int b) { return data_bits[a] > data_bits[b]; });
+
+      int step = std::max(kernels[arch].lanes, 1);
+      for (int first = 0; first < count; first += step) {
+        int group = std::min(step, count - first);
+        int a = arch;
+        while (a > ARCH_SSE2 && group <= kernels[a-1].lanes) a--;
+        if (a == ARCH_GENERIC || group < kernels[a].lanes / 2) {
+          for (int f = first; f < first + group; f++)
+            conv_decode(symbols[order[f]], data[order[f]], data_bits[order[f]]);
+          continue;
+        }
+        int lanes = kernels[a].lanes;
+
+        // Rounded up to whole stage pairs, so even the odd stage count of the longest block
+        // has its (cleared) decisions in memory
+        int nstages = ((data_bits[order[first]] + (K-1) + 1) / 2) * 2;
+        size_t syms_size = (size_t)nstages * RATE * lanes;
+        size_t metrics_size = 2 * NUMSTATES * lanes;
+        size_t size = syms_size + metrics_size + (size_t)nstages * NUMSTATES * (lanes / 8);
+        if (size > m_batch_size) {
+          free(m_batch_mem);
+          if (posix_memalign((void**)&m_batch_mem, 64, size)) {
+            m_batch_mem = NULL;
+            m_batch_size = 0;
+            return;
+          }
+          m_batch_size = size;
+        }
+        unsigned char *syms = m_batch_mem;
+        unsigned char *metrics = syms + syms_size;
+        unsigned char *dec = metrics + metrics_size;
+
+        // Interleave the symbols, the unused lanes and the padding of shorter blocks are zero.
+        // The lanes are sorted by decreasing length, so only a prefix of each row is in use.
+        memset(syms, 0, syms_size);
+        const unsigned char *in[64];
+        for (int l = 0; l < group; l++) in[l] = symbols[order[first + l]];
+        int used = group;
+        for (int i = 0; i < nstages; i++) {
+          while (used > 0 && data_bits[order[first + used - 1]] + (K-1) <= i) used--;
+          unsigned char *row = syms + (size_t)i * RATE * lanes;
+          for (int l = 0; l < used; l++) {
+            row[l] = in[l][RATE*i];
+            row[lanes + l] = in[l][RATE*i + 1];
+          }
+        }
+
+        memset(metrics, 63, NUMSTATES * lanes);
+        memset(metrics, 0, lanes); /* Bias known start state */
+
+        kernels[a].kernel(nstages, syms, metrics, dec, Branchtab);
+
+        int nbits[64];
+        unsigned char *out[64];
+        for (int l = 0; l < group; l++) {
+          nbits[l] = data_bits[order[first + l]];
+          out[l] = data[order[first + l]];
+        }
+        batch_chainback(dec, lanes, group, nbits, out);
+      }
+    }
+
+    /* Overlap of the segments of conv_decode_parallel in stages, about 14 constraint lengths */
+    #define SEGMENT_WARMUP 96
+    #define SEGMENT_TRACEBACK 96
+
+    /* Shortest segment worth a thread of its own, in data bits */
+    #define SEGMENT_MIN_BITS 4096
+
+    /*!
+     * \brief A thread with its own decoder that decodes one segment of each block handed to
+     *  conv_decode_parallel. The thread lives as long as the viterbi object that owns it, so
+     *  starting a thread isn't paid for every frame.
+     */
+    struct viterbi::segment_worker
+    {
+        viterbi decoder;              //!< Decoder of the segment, keeps its decision memory between blocks
+        sem_t start;                  //!< Posted when a segment is ready to be decoded
+        sem_t done;                   //!< Posted when the segment is decoded
+        bool stop;                    //!< Set before #start is posted to end the thread
+        const unsigned char *symbols; //!< Coded symbols of the whole block
+        unsigned char *data;          //!< Output data of the whole block
+        int data_bits;                //!< Number of data bits of the whole block
+        int first;                    //!< First data bit of the segment
+        int end;                      //!< End of the segment
+        std::thread thread;           //!< The thread running #run
+
+        segment_worker() : stop(false)
+        {
+          sem_init(&start, 0, 0);
+          sem_init(&done, 0, 0);
+          thread = std::thread(&segment_worker::run, this);
+        }
+
+        ~segment_worker()
+        {
+          stop = true;
+          sem_post(&start);
+          thread.join();
+          sem_destroy(&start);
+          sem_destroy(&done);
+        }
+
+        void run()
+        {
+          while (true) {
+            while (sem_wait(&start) != 0 && errno == EINTR);
+            if (stop) return;
+            decoder.segment_decode(symbols, data, data_bits, first, end);
+            sem_post(&done);
+          }
+        }
+    };
+
+    int viterbi::parallel_segments(int data_bits, int threads)
+    {
+      if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+      return std::max(1, std::min(threads, data_bits / SEGMENT_MIN_BITS));
+    }
+
+    /*!
+     *  The segments are byte aligned so that every decoder writes its own bytes of data. The
+     *  calling thread decodes the first segment itself while the workers decode the others.
+     */
+    void viterbi::conv_decode_parallel(unsigned char * symbols, unsigned char * data, int data_bits, int threads)
+    {
+      int segments = parallel_segments(data_bits, threads);
+      if (segments <= 1) {
+        conv_decode(symbols, data, data_bits);
+        return;
+      }
+
+      while ((int)m_segment_workers.size() < segments - 1)
+        m_segment_workers.emplace_back(new segment_worker());
+
+      int seg_bytes = (data_bits / 8 + segments - 1) / segments;
+      for (int s = 1; s < segments; s++) {
+        segment_worker *worker = m_segment_workers[s-1].get();
+        worker->symbols = symbols;
+        worker->data = data;
+        worker->data_bits = data_bits;
+        worker->first = s * seg_bytes * 8;
+        worker->end = (s == segments - 1) ? data_bits : std::min(data_bits, worker->first + seg_bytes * 8);
+        sem_post(&worker->start);
+      }
+      segment_decode(symbols, data, data_bits, 0, seg_bytes * 8);
+
+      for (int s = 1; s < segments; s++)
+        while (sem_wait(&m_segment_workers[s-1]->done) != 0 && errno == EINTR);
+    }
+
+    void viterbi::segment_decode(const unsigned char *symbols, unsigned char *data, int data_bits, int start, int end)
+    {
+      int nstages = data_bits + (K-1);
+
+      // Start on an even stage so that a trailing odd stage is skipped like in conv_decode
+      int first = std::max(0, (start + (K-1) - SEGMENT_WARMUP) & ~1);
+      bool last = (end >= data_bits);
+      int count = last ? nstages - first : ((end + (K-1) + SEGMENT_TRACEBACK - first) & ~1);
+
+      struct v *vp = viterbi_reserve(count);
+      if (vp == NULL) return;
+
+      viterbi_init(vp, 0);
+      if (first > 0)
+        memset(vp->old_metrics->t, 0, NUMSTATES); /* State unknown, all equally likely */
+
+      viterbi_update_blk(vp, symbols + first * RATE, count);
+
+      unsigned int endstate = 0;
+      if (!last) {
+        const COMPUTETYPE *m = vp->old_metrics->t;
+        endstate = std::min_element(m, m + NUMSTATES) - m;
+      }
+
+      // Same recursion as viterbi_chainback, only the bytes of the segment are stored
+      endstate <<= (8-(K-1));
+      decision_t *d = vp->decisions;
+      for (int i = first + count - 1 - (K-1); i >= start; i--) {
+        unsigned int k = (d[i + (K-1) - first].l[0] >> (endstate >> (8-(K-1)))) & 1;
+        endstate = (endstate >> 1) | (k << 7);
+        if (i < end && i % 8 == 0) data[i >> 3] = endstate;
+      }
+    }
+
+    /*!
+     *  Thin wrapper around the table driven encoder, one symbol byte per coded bit.
+     */
     void viterbi::conv_encode(unsigned char * data, unsigned char * symbols, int data_bits)
     {
-        int symbol_count = RATE * (data_bits + 6);
-        memset(symbols, 0, symbol_count);
+        conv_encode(data, symbols, data_bits, PUNCTURE_NONE);
+    }
 
-        int polys[RATE] = POLYS;
-        int sr = 0;
+    /*!
+     * \brief Lookup tables of the byte-at-a-time encoder.
+     *
+     * The code is linear, so the 16 coded bits of an input byte are the coded bits of the
+     * 6 register bits before it xor the coded bits of the byte itself. Coded bits are MSB first,
+     * i.e. bit 15 is the first symbol of the first input bit.
+     */
+    struct encoder_tables
+    {
+        unsigned short state_out[NUMSTATES]; //!< Coded bits of a zero byte after each register state
+        unsigned short byte_out[256];        //!< Coded bits of each byte after the zero state
+        unsigned long long expand[256];      //!< 8 coded bits to 8 symbol bytes (first symbol in the lowest byte)
+        unsigned char kept_bits[PUNCTURE_COUNT][3][256];  //!< 8 coded bits with the punctured ones squeezed out, MSB aligned
+        unsigned char kept_count[PUNCTURE_COUNT][3][256]; //!< Number of bits left in #kept_bits
+
+        encoder_tables()
+        {
+            int polys[RATE] = POLYS;
+            for(int x = 0; x < 256; x++)
+            {
+                // Register state x followed by a zero byte, and byte x after the zero state
+                int sr_state = x & (NUMSTATES-1), sr_byte = 0;
+                unsigned int w_state = 0, w_byte = 0;
+                for(int j = 0; j < 8; j++)
+                {
+                    sr_state = sr_state << 1;
+                    sr_byte = (sr_byte << 1) | ((x >> (7 - j)) & 1);
+                    for(int k = 0; k < RATE; k++)
+                    {
+                        w_state = (w_state << 1) | parity(sr_state & polys[k]);
+                        w_byte = (w_byte << 1) | parity(sr_byte & polys[k]);
+                    }
+                }
+                if(x < NUMSTATES) state_out[x] = w_state;
+                byte_out[x] = w_byte;
+
+                expand[x] = 0;
+                for(int j = 0; j < 8; j++) expand[x] |= (unsigned long long)((x >> (7 - j)) & 1) << (8 * j);
+
+                // A group of 8 coded bits always starts at an even offset into the pattern
+                for(int p = 0; p < PUNCTURE_COUNT; p++)
+                {
+                    for(int phase = 0; phase < 3; phase++)
+                    {
+                        int bits = 0, count = 0;
+                        for(int j = 0; j < 8; j++)
+                        {
+                            if(!((PUNCTURE_KEEP[p] >> ((2 * phase + j) % PUNCTURE_PERIOD[p])) & 1)) continue;
+                            bits |= ((x >> (7 - j)) & 1) << (7 - count);
+                            count++;
+                        }
+                        kept_bits[p][phase][x] = bits;
+                        kept_count[p][phase][x] = count;
+                    }
+                }
+            }
+        }
+    };
+
+    static const encoder_tables & get_encoder_tables()
+    {
+        static const encoder_tables tables;
+        return tables;
+    }
+
+    /*!
+     *  Number of coded symbols that are left of coded_count after puncturing.
+     */
+    static int punctured_count(int coded_count, puncturing pattern)
+    {
+        int period = PUNCTURE_PERIOD[pattern];
+        int count = (coded_count / period) * __builtin_popcount(PUNCTURE_KEEP[pattern]);
+        for(int k = 0; k < coded_count % period; k++) count += (PUNCTURE_KEEP[pattern] >> k) & 1;
+        return count;
+    }
 
-        int index = 0;
-        for(int i = 0; i < data_bits+(K-1); i++) {
+    /*!
+     *  Collects the surviving coded bits either as symbol bytes or packed into bytes.
+     */
+    template<bool PACKED>
+    struct encoder_output
+    {
+        unsigned char * out;
+        unsigned char * end;
+        unsigned long long acc;
+        int nacc;
+
+        inline void put(const encoder_tables & t, int bits, int count)
+        {
+            if(PACKED)
+            {
+                acc = (acc << count) | (bits >> (8 - count));
+                nacc += count;
+                if(nacc >= 8)
+                {
+                    nacc -= 8;
+                    *out++ = acc >> nacc;
+                }
+            }
+            else
+            {
+                // The last group may not have room for the full 8 byte store
+                if(end - out >= 8) memcpy(out, &t.expand[bits], 8);
+                else memcpy(out, &t.expand[bits], count);
+                out += count;
+            }
+        }
 
-            int b = data[i/8];
-            int j = i % 8;
-            int bit = (b >> (7 - j)) & 1;
+        inline void flush()
+        {
+            if(PACKED && nacc > 0) *out++ = acc << (8 - nacc);
+        }
+    };
 
-            sr = (sr << 1) | bit;
+    /*!
+     *  Works on one input byte at a time: two table lookups give its 16 coded bits, which are
+     *  punctured 8 at a time with the squeeze tables. The last partial byte (if the bit count
+     *  isn't a multiple of 8) goes bit by bit.
+     */
+    template<int PATTERN, bool PACKED>
+    static void encode_bytes(const unsigned char * data, int total_bits, unsigned char * symbols, int symbol_count)
+    {
+        const int period = PUNCTURE_PERIOD[PATTERN];
+        const encoder_tables & t = get_encoder_tables();
+        const unsigned char (*kept_bits)[256] = t.kept_bits[PATTERN];
+        const unsigned char (*kept_count)[256] = t.kept_count[PATTERN];
+
+        encoder_output<PACKED> o = { symbols, symbols + (PACKED ? (symbol_count + 7) / 8 : symbol_count), 0, 0 };
+        int sr = 0, phase = 0;
+        for(int x = 0; x < total_bits / 8; x++)
+        {
+            int b = data[x];
+            int w = t.state_out[sr] ^ t.byte_out[b];
+            sr = b & (NUMSTATES-1);
+
+            int hi = w >> 8, lo = w & 0xFF;
+            o.put(t, kept_bits[phase][hi], kept_count[phase][hi]);
+            phase = (2 * phase + 8) % period / 2;
+            o.put(t, kept_bits[phase][lo], kept_count[phase][lo]);
+            phase = (2 * phase + 8) % period / 2;
+        }
+
+        int polys[RATE] = POLYS;
+        int offset = 2 * phase;
+        for(int i = total_bits & ~7; i < total_bits; i++)
+        {
+            sr = (sr << 1) | ((data[i/8] >> (7 - i % 8)) & 1);
             for(int k = 0; k < RATE; k++)
             {
-              int m = sr & polys[k];
-              int par = parity(sr & polys[k]);
-              symbols[index++] = par;
+                if((PUNCTURE_KEEP[PATTERN] >> offset) & 1) o.put(t, parity(sr & polys[k]) << 7, 1);
+                offset = (offset + 1) % period;
             }
         }
+        o.flush();
+    }
+
+    int viterbi::conv_encode(const unsigned char * data, unsigned char * symbols, int data_bits, puncturing pattern, bool packed)
+    {
+        typedef void (*encoder)(const unsigned char *, int, unsigned char *, int);
+        static const encoder encoders[PUNCTURE_COUNT][2] = {
+            { &encode_bytes<PUNCTURE_NONE, false>, &encode_bytes<PUNCTURE_NONE, true> },
+            { &encode_bytes<PUNCTURE_2_3, false>, &encode_bytes<PUNCTURE_2_3, true> },
+            { &encode_bytes<PUNCTURE_3_4, false>, &encode_bytes<PUNCTURE_3_4, true> }
+        };
+
+        int total_bits = data_bits + (K-1);
+        int symbol_count = punctured_count(RATE * total_bits, pattern);
+        encoders[pattern][packed](data, total_bits, symbols, symbol_count);
+        return symbol_count;
     }
 
     /* Initialize Viterbi decoder for start of new frame */
@@ -77,31 +484,30 @@ namespace fun
       vp->old_metrics->t[starting_state & (NUMSTATES-1)] = 0; /* Bias known start state */
     }
 
-    /* Create a new instance of a Viterbi decoder */
-    struct v * viterbi::viterbi_alloc(int len) {
-      struct v *vp;
-      static int Init = 0;
-
-        int state, i;
-        int polys[RATE] = POLYS;
-        for (state=0;state < NUMSTATES/2;state++) {
-          for (i=0; i<RATE; i++) {
-            Branchtab[i*NUMSTATES/2+state] = (polys[i] < 0) ^ parity((2*state) & abs(polys[i])) ? 255 : 0;
-          }
+    /* Make sure the decoder state can hold a frame of len data bits */
+    struct v * viterbi::viterbi_reserve(int len) {
+      if (m_vp == NULL) {
+        if (posix_memalign((void**)&m_vp, 16, sizeof(struct v))) {
+          m_vp = NULL;
+          return NULL;
         }
-        Init++;
-
-      if (posix_memalign((void**)&vp, 16,sizeof(struct v)))
-        return NULL;
+        m_vp->decisions = NULL;
+        m_max_bits = 0;
+      }
 
-      // NOTE: a frame-worth of decisions!
-      if (posix_memalign((void**)&vp->decisions, 16,(len+(K-1))*sizeof(decision_t))) {
-        free(vp);
-        return NULL;
+      if (len > m_max_bits) {
+        // NOTE: a frame-worth of decisions! Grow geometrically so a slowly growing frame
+        // length doesn't reallocate every time.
+        int max_bits = std::max(len, 2 * m_max_bits);
+        decision_t *decisions;
+        if (posix_memalign((void**)&decisions, 16, (max_bits+(K-1))*sizeof(decision_t)))
+          return NULL;
+        free(m_vp->decisions);
+        m_vp->decisions = decisions;
+        m_max_bits = max_bits;
       }
-      viterbi_init(vp, 0);
 
-      return vp;
+      return m_vp;
     }
 
     /* Viterbi chainback */
@@ -130,40 +536,46 @@ namespace fun
        */
       endstate = (endstate % NUMSTATES) << ADDSHIFT;
 
-      /* The store into data[] only needs to be done every 8 bits.
-       * But this avoids a conditional branch, and the writes will
-       * combine in the cache anyway
+      /* Each decision vector is read as one 64 bit word. A decoded byte is only
+       * complete (and stored) once its first bit has been traced back, so the
+       * partial top byte is handled first and then 8 bits go per iteration.
        */
       d += (K-1); /* Look past tail */
-      while (nbits-- != 0) {
-        int k = (d[nbits].w[(endstate >> ADDSHIFT)/32] >> ((endstate >> ADDSHIFT)%32)) & 1;
-        endstate = (endstate >> 1) | (k << (K-2+ADDSHIFT));
+    #define CHAINBACK_BIT(i) \
+        endstate = (endstate >> 1) | ((unsigned int)((d[i].l[0] >> (endstate >> ADDSHIFT)) & 1) << (K-2+ADDSHIFT))
+
+      while (nbits % 8 != 0) {
+        nbits--;
+        CHAINBACK_BIT(nbits);
+        if (nbits % 8 == 0) data[nbits >> 3] = endstate >> SUBSHIFT;
+      }
+      while (nbits != 0) {
+        nbits -= 8;
+        CHAINBACK_BIT(nbits + 7);
+        CHAINBACK_BIT(nbits + 6);
+        CHAINBACK_BIT(nbits + 5);
+        CHAINBACK_BIT(nbits + 4);
+        CHAINBACK_BIT(nbits + 3);
+        CHAINBACK_BIT(nbits + 2);
+        CHAINBACK_BIT(nbits + 1);
+        CHAINBACK_BIT(nbits);
         data[nbits >> 3] = endstate >> SUBSHIFT;
       }
+    #undef CHAINBACK_BIT
 
     #undef ADDSHIRT
     #undef SUBSHIFT
     }
 
-    /*!
-     * \brief Delete instance of a Viterbi decoder
-     * \param vp
-     */
-    void viterbi::viterbi_free(struct v *vp) {
-      if (vp != NULL) {
-        free(vp->decisions);
-        free(vp);
-      }
-    }
-
     /*!
      * \brief viterbi::viterbi_decode
      * \param vp
      * \param symbols
      * \param data
      * \param nbits
+     * \param pattern
      */
-    void viterbi::viterbi_decode(struct v *vp, const COMPUTETYPE *symbols, unsigned char *data, int nbits) {
+    void viterbi::viterbi_decode(struct v *vp, const COMPUTETYPE *symbols, unsigned char *data, int nbits, puncturing pattern) {
       // vp = viterbi decoder
       // data = decoded
       // symbols = signal
@@ -173,8 +585,7 @@ namespace fun
       viterbi_init(vp, 0);
 
       /* Decode block */
-      //vp->update_blk(vp, symbols, nbits+(K-1));
-      viterbi_update_blk_SPIRAL(vp, symbols, nbits + (K-1));
+      viterbi_update_blk(vp, symbols, nbits + (K-1), pattern);
 
       /* Do Viterbi chainback */
       viterbi_chainback(vp, data, nbits, 0);
@@ -182,18 +593,423 @@ namespace fun
 
 
     /*!
-     * \brief viterbi::viterbi_update_blk_SPIRAL
+     * \brief viterbi::viterbi_update_blk
      * \param vp
      * \param syms
      * \param nbits
+     * \param pattern
      */
-    void viterbi::viterbi_update_blk_SPIRAL(struct v *vp, const COMPUTETYPE *syms, int nbits) {
+    void viterbi::viterbi_update_blk(struct v *vp, const COMPUTETYPE *syms, int nbits, puncturing pattern) {
       decision_t *d = (decision_t *)vp->decisions;
 
-      for (int s = 0; s < nbits; s++)
-        memset(d+s, 0, sizeof(decision_t));
+      // The kernels write every decision of the stage pairs they process, only an odd
+      // trailing stage is left untouched
+      if (nbits & 1)
+        memset(d+nbits-1, 0, sizeof(decision_t));
+
+      acs(pattern)(nbits, vp->new_metrics->t, vp->old_metrics->t, syms, d->t, Branchtab);
+    }
+
+    /* Stages run between two checks for decoded bytes to hand out */
+    #define STREAM_CHUNK 64
+
+    /*!
+     *  The decisions of the stream are kept in the decision memory of #m_vp, used as a ring
+     *  of #m_stream_cap stages. Between two tracebacks at most STREAM_CHUNK stages are added
+     *  and a traceback leaves fewer than STREAM_CHUNK + 8 bits pending, so the ring never
+     *  needs to hold more than the traceback depth plus two chunks.
+     */
+    bool viterbi::stream_begin(int traceback_depth)
+    {
+      m_tb_depth = std::max(traceback_depth, K);
+      m_stream_cap = ((m_tb_depth + 2 * STREAM_CHUNK + 8 + (K-1)) / 2 + 1) * 2;
+      struct v *vp = viterbi_reserve(m_stream_cap - (K-1));
+      if (vp == NULL) return false;
+
+      viterbi_init(vp, 0);
+      m_stages = 0;
+      m_emitted = 0;
+      m_npending = 0;
+      return true;
+    }
+
+    int viterbi::stream_decode(const unsigned char * symbols, int count, unsigned char * data)
+    {
+      int bytes = 0;
+
+      // Complete a pending pair of stages first
+      if (m_npending > 0) {
+        int n = std::min(count, 2*RATE - m_npending);
+        memcpy(m_pending + m_npending, symbols, n);
+        m_npending += n;
+        symbols += n;
+        count -= n;
+        if (m_npending < 2*RATE) return 0;
+        bytes += stream_update(m_pending, 2*RATE, data);
+        m_npending = 0;
+      }
+
+      int whole = count - count % (2*RATE);
+      bytes += stream_update(symbols, whole, data + bytes);
+
+      m_npending = count - whole;
+      memcpy(m_pending, symbols + whole, m_npending);
+      return bytes;
+    }
+
+    /*!
+     *  The stream is terminated in state 0, so the final traceback starts there and covers
+     *  every bit that hasn't been handed out yet.
+     */
+    int viterbi::stream_end(unsigned char * data)
+    {
+      // Like viterbi_update_blk, an odd trailing stage is not run and gets a zero decision
+      if (m_npending >= RATE) {
+        memset(&m_vp->decisions[m_stages % m_stream_cap], 0, sizeof(decision_t));
+        m_stages++;
+      }
+      m_npending = 0;
+
+      long long nbits = m_stages - (K-1);
+      if (nbits <= m_emitted) return 0;
+      return stream_traceback(0, nbits, data);
+    }
+
+    int viterbi::stream_update(const COMPUTETYPE *syms, int count, unsigned char *data)
+    {
+      acs_kernel kernel = acs();
+      int bytes = 0;
+      int stages = count / RATE;
+
+      while (stages > 0) {
+        // Stop at the end of the ring, it holds an even number of stages so pairs never wrap
+        int pos = m_stages % m_stream_cap;
+        int n = std::min(std::min(stages, STREAM_CHUNK), m_stream_cap - pos);
+        kernel(n, m_vp->new_metrics->t, m_vp->old_metrics->t, syms, m_vp->decisions[pos].t, Branchtab);
+        m_stages += n;
+        syms += n * RATE;
+        stages -= n;
 
-      FULL_SPIRAL(nbits, vp->new_metrics->t, vp->old_metrics->t, syms, d->t, Branchtab);
+        long long ready = m_stages - (K-1) - m_tb_depth - m_emitted;
+        if (ready >= STREAM_CHUNK) {
+          // Start from the best state, the surviving paths have merged by traceback depth
+          const COMPUTETYPE *m = m_vp->old_metrics->t;
+          unsigned int best = std::min_element(m, m + NUMSTATES) - m;
+          bytes += stream_traceback(best << (8-(K-1)), m_emitted + (ready & ~7LL), data + bytes);
+        }
+      }
+      return bytes;
+    }
+
+    /*!
+     *  Same recursion as #viterbi_chainback, from the last processed stage back to the first
+     *  bit that hasn't been handed out. Only the bytes below end_bit are stored.
+     */
+    int viterbi::stream_traceback(unsigned int endstate, long long end_bit, unsigned char *data)
+    {
+      decision_t *d = m_vp->decisions;
+      int pos = (m_stages - 1) % m_stream_cap;
+      for (long long i = m_stages - 1 - (K-1); i >= m_emitted; i--) {
+        unsigned int k = (d[pos].l[0] >> (endstate >> (8-(K-1)))) & 1;
+        endstate = (endstate >> 1) | (k << 7);
+        if (i < end_bit && i % 8 == 0) data[(i - m_emitted) >> 3] = endstate;
+        pos = (pos == 0) ? m_stream_cap - 1 : pos - 1;
+      }
+
+      int bytes = (end_bit - m_emitted + 7) / 8;
+      m_emitted = end_bit;
+      return bytes;
+    }
+
+    /*
+     * Puncturing patterns for the kernels. STAGES trellis stages make up one period of the
+     * pattern and kept(k) tells whether coded symbol k of a period is transmitted. The kernels
+     * read the punctured stream directly and use the erasure value 127 (what
+     * puncturer::depuncture fills in) for dropped symbols. That is a compile-time constant in
+     * each specialization, so the branch metric term of a dropped symbol costs nothing. The
+     * exception is the SSE2 kernel, #FULL_SPIRAL_PUNCTURED still depunctures into a 96 stage
+     * buffer and runs #FULL_SPIRAL on that.
+     */
+    struct punct_none { enum { STAGES = 1 }; static constexpr bool kept(int) { return true; } };
+    struct punct_2_3 { enum { STAGES = 2 }; static constexpr bool kept(int k) { return k != 1; } };
+    struct punct_3_4 { enum { STAGES = 3 }; static constexpr bool kept(int k) { return k != 2 && k != 4; } };
+
+    /* Symbols of stage j of the pattern period, advancing syms past the transmitted ones */
+    template<class P>
+    static inline void stage_symbols(const unsigned char *&syms, int j, unsigned char &s0, unsigned char &s1) {
+        s0 = P::kept(2*j) ? *syms++ : 127;
+        s1 = P::kept(2*j+1) ? *syms++ : 127;
+    }
+
+    /*
+     * Scalar version of FULL_SPIRAL. Butterfly b (0-31) combines old states b and b+32 into
+     * new states 2b and 2b+1, using saturating 8-bit metrics and the same renormalization
+     * threshold so that the decisions are bit-identical.
+     */
+    template<class P>
+    static void full_generic(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        for(int i = 0; i < (nbits/2)*2; i++) {
+            unsigned char *old_m = (i & 1) ? Y : X;
+            unsigned char *new_m = (i & 1) ? X : Y;
+            unsigned char s0, s1;
+            stage_symbols<P>(syms, i % P::STAGES, s0, s1);
+            unsigned char *d = dec + i * (NUMSTATES/8);
+
+            memset(d, 0, NUMSTATES/8);
+            for(int b = 0; b < NUMSTATES/2; b++) {
+                int t = (((s0 ^ Branchtab[b]) + (s1 ^ Branchtab[b + NUMSTATES/2]) + 1) >> 1) >> 2;
+                int m0 = std::min(old_m[b] + t, 255);
+                int m1 = std::min(old_m[b + NUMSTATES/2] + (63 - t), 255);
+                int m2 = std::min(old_m[b] + (63 - t), 255);
+                int m3 = std::min(old_m[b + NUMSTATES/2] + t, 255);
+
+                new_m[2*b] = std::min(m0, m1);
+                new_m[2*b+1] = std::min(m2, m3);
+                d[b/4] |= ((m1 <= m0) << ((2*b) % 8)) | ((m3 <= m2) << ((2*b+1) % 8));
+            }
+
+            if(new_m[0] > 210) {
+                unsigned char min_m = new_m[0];
+                for(int s = 1; s < NUMSTATES; s++) min_m = std::min(min_m, new_m[s]);
+                for(int s = 0; s < NUMSTATES; s++) new_m[s] -= min_m;
+            }
+        }
+    }
+
+    /*!
+     * \brief viterbi::FULL_GENERIC
+     * \param nbits
+     * \param Y
+     * \param X
+     * \param syms
+     * \param dec
+     * \param Branchtab
+     *
+     * Scalar version of #FULL_SPIRAL, see full_generic.
+     */
+    void viterbi::FULL_GENERIC(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        full_generic<punct_none>(nbits, Y, X, syms, dec, Branchtab);
+    }
+
+    /*
+     * Minimum of the 32 bytes in m, broadcast to every byte of a 256 bit register.
+     */
+    __attribute__((target("avx2")))
+    static inline __m256i min_epu8_avx2(__m256i m) {
+        __m128i m7 = _mm_min_epu8(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+        m7 = _mm_min_epu8(m7, _mm_srli_si128(m7, 8));
+        m7 = _mm_minpos_epu16(_mm_cvtepu8_epi16(m7));
+        return _mm256_broadcastb_epi8(m7);
+    }
+
+    /*
+     * Branch metric of the butterflies for one stage, t = avg(s0 ^ bt0, s1 ^ bt1) >> 2.
+     */
+    __attribute__((target("avx2")))
+    static inline __m256i branch_metric_avx2(__m256i bt0, __m256i bt1, unsigned char s0, unsigned char s1) {
+        __m256i t = _mm256_avg_epu8(_mm256_xor_si256(_mm256_set1_epi8(s0), bt0),
+                                    _mm256_xor_si256(_mm256_set1_epi8(s1), bt1));
+        return _mm256_and_si256(_mm256_srli_epi16(t, 2), _mm256_set1_epi8(63));
+    }
+
+    /*
+     * One trellis stage. lo/hi hold the metrics of states 0-31/32-63 and are replaced by the
+     * new metrics in the same layout. The 64 decision bits are stored in dec[0] and dec[1].
+     */
+    __attribute__((target("avx2")))
+    static inline void acs_stage_avx2(__m256i &lo, __m256i &hi, __m256i bt0, __m256i bt1,
+                                      unsigned char s0, unsigned char s1, unsigned int *dec) {
+        const __m256i max_metric = _mm256_set1_epi8(63);
+        __m256i t = branch_metric_avx2(bt0, bt1, s0, s1);
+        __m256i nt = _mm256_subs_epu8(max_metric, t);
+
+        __m256i m0 = _mm256_adds_epu8(lo, t);
+        __m256i m1 = _mm256_adds_epu8(hi, nt);
+        __m256i m2 = _mm256_adds_epu8(lo, nt);
+        __m256i m3 = _mm256_adds_epu8(hi, t);
+        __m256i even = _mm256_min_epu8(m1, m0);
+        __m256i odd = _mm256_min_epu8(m3, m2);
+        __m256i d_even = _mm256_cmpeq_epi8(even, m1);
+        __m256i d_odd = _mm256_cmpeq_epi8(odd, m3);
+
+        // unpack works per 128 bit lane: [new 0-15 | new 32-47] and [new 16-31 | new 48-63]
+        __m256i n_a = _mm256_unpacklo_epi8(even, odd);
+        __m256i n_b = _mm256_unpackhi_epi8(even, odd);
+        unsigned int d_a = _mm256_movemask_epi8(_mm256_unpacklo_epi8(d_even, d_odd));
+        unsigned int d_b = _mm256_movemask_epi8(_mm256_unpackhi_epi8(d_even, d_odd));
+        dec[0] = (d_a & 0xFFFF) | (d_b << 16);
+        dec[1] = (d_a >> 16) | (d_b & 0xFFFF0000);
+
+        lo = _mm256_permute2x128_si256(n_a, n_b, 0x20);
+        hi = _mm256_permute2x128_si256(n_a, n_b, 0x31);
+        if ((_mm_cvtsi128_si32(_mm256_castsi256_si128(lo)) & 0xFF) > 210) {
+            __m256i m = min_epu8_avx2(_mm256_min_epu8(lo, hi));
+            lo = _mm256_subs_epu8(lo, m);
+            hi = _mm256_subs_epu8(hi, m);
+        }
+    }
+
+    /*
+     * Same trellis as FULL_SPIRAL, but the metrics stay in two registers for the whole block.
+     */
+    template<class P>
+    __attribute__((target("avx2")))
+    static void full_avx2(int nbits, unsigned char * /* Y */, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        __m256i bt0 = _mm256_loadu_si256((const __m256i *)Branchtab);
+        __m256i bt1 = _mm256_loadu_si256((const __m256i *)(Branchtab + NUMSTATES/2));
+        __m256i lo = _mm256_loadu_si256((const __m256i *)X);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(X + NUMSTATES/2));
+        unsigned int *d = (unsigned int *)dec;
+
+        int n = (nbits/2)*2;
+        for(int i = 0; i < n; ) {
+            for(int j = 0; j < P::STAGES && i < n; j++, i++) {
+                unsigned char s0, s1;
+                stage_symbols<P>(syms, j, s0, s1);
+                acs_stage_avx2(lo, hi, bt0, bt1, s0, s1, d + 2*i);
+            }
+        }
+
+        _mm256_storeu_si256((__m256i *)X, lo);
+        _mm256_storeu_si256((__m256i *)(X + NUMSTATES/2), hi);
+    }
+
+    /*!
+     * \brief viterbi::FULL_AVX2
+     * \param nbits
+     * \param Y
+     * \param X
+     * \param syms
+     * \param dec
+     * \param Branchtab
+     */
+    void viterbi::FULL_AVX2(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        full_avx2<punct_none>(nbits, Y, X, syms, dec, Branchtab);
+    }
+
+    /*
+     * One trellis stage on 512 bit registers. The butterflies are computed in one go as
+     * min([lo|lo] + [t|63-t], [hi|hi] + [63-t|t]), i.e. even new states in the lower and odd
+     * ones in the upper half. The metrics are kept as [lo|lo] and [hi|hi] so that a single
+     * VBMI byte permute per register goes straight from the butterfly outputs to the inputs
+     * of the next stage.
+     */
+    __attribute__((target("avx512f,avx512bw,avx512vbmi,bmi2")))
+    static inline void acs_stage_avx512(__m512i &lolo, __m512i &hihi, __m512i t_nt_mask, __m512i idx_lo, __m512i idx_hi,
+                                        __m256i bt0, __m256i bt1, unsigned char s0, unsigned char s1, unsigned long long *dec) {
+        __m256i t = branch_metric_avx2(bt0, bt1, s0, s1);
+        __m512i tt = _mm512_inserti64x4(_mm512_castsi256_si512(t), t, 1);
+        __m512i t_nt = _mm512_xor_si512(tt, t_nt_mask);            // [t|63-t], 63-t == t^63 for t < 64
+        __m512i nt_t = _mm512_xor_si512(tt, _mm512_set1_epi8(63) ^ t_nt_mask);
+
+        __m512i u = _mm512_adds_epu8(lolo, t_nt);
+        __m512i v = _mm512_adds_epu8(hihi, nt_t);
+        __m512i n = _mm512_min_epu8(u, v);
+
+        // Decision bit b belongs to new state 2b (b < 32) or 2(b-32)+1
+        unsigned long long d = _mm512_cmpeq_epi8_mask(n, v);
+        *dec = _pdep_u64(d, 0x5555555555555555ULL) | _pdep_u64(d >> 32, 0xAAAAAAAAAAAAAAAAULL);
+
+        lolo = _mm512_permutexvar_epi8(idx_lo, n);
+        hihi = _mm512_permutexvar_epi8(idx_hi, n);
+
+        if ((_mm_cvtsi128_si32(_mm512_castsi512_si128(lolo)) & 0xFF) > 210) {
+            __m256i mn = min_epu8_avx2(_mm256_min_epu8(_mm512_castsi512_si256(n), _mm512_extracti64x4_epi64(n, 1)));
+            __m512i m = _mm512_inserti64x4(_mm512_castsi256_si512(mn), mn, 1);
+            lolo = _mm512_subs_epu8(lolo, m);
+            hihi = _mm512_subs_epu8(hihi, m);
+        }
+    }
+
+    template<class P>
+    __attribute__((target("avx512f,avx512bw,avx512vbmi,bmi2")))
+    static void full_avx512(int nbits, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        // New state s is butterfly output s/2 of the even (first 32 bytes) or odd (last 32 bytes) half
+        unsigned char idx[2][64] __attribute__ ((aligned (64)));
+        for (int j = 0; j < 64; j++) {
+            int s = j % 32;
+            idx[0][j] = (s / 2) + (s % 2) * 32;
+            idx[1][j] = (s + 32) / 2 + (s % 2) * 32;
+        }
+        __m512i idx_lo = _mm512_load_si512(idx[0]);
+        __m512i idx_hi = _mm512_load_si512(idx[1]);
+        __m512i t_nt_mask = _mm512_inserti64x4(_mm512_setzero_si512(), _mm256_set1_epi8(63), 1);
+
+        __m256i bt0 = _mm256_loadu_si256((const __m256i *)Branchtab);
+        __m256i bt1 = _mm256_loadu_si256((const __m256i *)(Branchtab + NUMSTATES/2));
+        __m256i lo = _mm256_loadu_si256((const __m256i *)X);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(X + NUMSTATES/2));
+        __m512i lolo = _mm512_inserti64x4(_mm512_castsi256_si512(lo), lo, 1);
+        __m512i hihi = _mm512_inserti64x4(_mm512_castsi256_si512(hi), hi, 1);
+        unsigned long long *d = (unsigned long long *)dec;
+
+        int n = (nbits/2)*2;
+        for(int i = 0; i < n; ) {
+            for(int j = 0; j < P::STAGES && i < n; j++, i++) {
+                unsigned char s0, s1;
+                stage_symbols<P>(syms, j, s0, s1);
+                acs_stage_avx512(lolo, hihi, t_nt_mask, idx_lo, idx_hi, bt0, bt1, s0, s1, d + i);
+            }
+        }
+
+        _mm256_storeu_si256((__m256i *)X, _mm512_castsi512_si256(lolo));
+        _mm256_storeu_si256((__m256i *)(X + NUMSTATES/2), _mm512_castsi512_si256(hihi));
+    }
+
+    template<class P>
+    static void full_avx512_or_avx2(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        // Without VBMI the interleave takes several cross-lane shuffles per stage, the AVX2 kernel is faster
+        if (cpu_features::has_avx512_vbmi())
+            full_avx512<P>(nbits, X, syms, dec, Branchtab);
+        else
+            full_avx2<P>(nbits, Y, X, syms, dec, Branchtab);
+    }
+
+    /*!
+     * \brief viterbi::FULL_AVX512
+     * \param nbits
+     * \param Y
+     * \param X
+     * \param syms
+     * \param dec
+     * \param Branchtab
+     *
+     * Same trellis as #FULL_SPIRAL, but the metrics stay in registers for the whole block.
+     */
+    void viterbi::FULL_AVX512(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        full_avx512_or_avx2<punct_none>(nbits, Y, X, syms, dec, Branchtab);
+    }
+
+    template<class P>
+    void viterbi::FULL_SPIRAL_PUNCTURED(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab) {
+        // A multiple of every pattern period, and even so that the kernel runs all stages
+        const int chunk = 96;
+        unsigned char buf[RATE * chunk];
+        for(int i = 0; i < nbits; i += chunk) {
+            int n = std::min(chunk, nbits - i);
+            for(int j = 0; j < n; j++)
+                stage_symbols<P>(syms, j % P::STAGES, buf[2*j], buf[2*j+1]);
+            FULL_SPIRAL(n, Y, X, buf, dec + i * (NUMSTATES/8), Branchtab);
+        }
+    }
+
+    /*!
+     * \brief viterbi::acs
+     * \param pattern
+     *
+     * The kernel is picked from the tables below according to cpu_features::active(). Each
+     * puncturing pattern has its own compile-time specialization of the kernels.
+     */
+    viterbi::acs_kernel viterbi::acs(puncturing pattern) {
+      static const acs_kernel kernels[PUNCTURE_COUNT][ARCH_COUNT] = {
+          { &viterbi::FULL_GENERIC, &viterbi::FULL_SPIRAL,
+            &viterbi::FULL_AVX2, &viterbi::FULL_AVX512 },
+          { &full_generic<punct_2_3>, &viterbi::FULL_SPIRAL_PUNCTURED<punct_2_3>,
+            &full_avx2<punct_2_3>, &full_avx512_or_avx2<punct_2_3> },
+          { &full_generic<punct_3_4>, &viterbi::FULL_SPIRAL_PUNCTURED<punct_3_4>,
+            &full_avx2<punct_3_4>, &full_avx512_or_avx2<punct_3_4> }
+      };
+      return cpu_features::select(kernels[pattern]);
     }
 
     /*!
@@ -458,5 +1274,220 @@ namespace fun
         /* skip */
     }
 
-}
+    /*
+     * Same recursion as viterbi_chainback for every lane, mask_t being the lane mask type of
+     * the kernel. The lanes are traced back together so that their (independent) decision
+     * lookups overlap.
+     */
+    template<typename mask_t>
+    static void batch_chainback_lanes(const mask_t *dec, int count, const int *nbits, unsigned char * const *data)
+    {
+      // As in viterbi_chainback the state sits in the top K-1 bits of a byte wide register,
+      // the bits shifted out below it complete the decoded byte
+      unsigned int endstate[64] = { 0 };
+      int active = 0;
+      for (int i = nbits[0] - 1; i >= 0; i--) {
+        // Lanes are sorted by decreasing length, the ones still being traced back are a prefix
+        while (active < count && nbits[active] > i) active++;
+        const mask_t *d = dec + (size_t)(i + (K-1)) * NUMSTATES;
+        for (int l = 0; l < active; l++) {
+          unsigned int k = (d[endstate[l] >> (8-(K-1))] >> l) & 1;
+          endstate[l] = (endstate[l] >> 1) | (k << 7);
+        }
+        if (i % 8 == 0) {
+          for (int l = 0; l < active; l++) data[l][i >> 3] = endstate[l];
+        }
+      }
+    }
+
+    /*!
+     * Like #viterbi_update_blk, a block with an odd number of stages gets a zero decision for
+     * its last stage, so those decision bits are cleared first.
+     */
+    void viterbi::batch_chainback(unsigned char *dec, int lanes, int count, const int *nbits, unsigned char * const *data)
+    {
+      int stride = lanes / 8;
+      for (int l = 0; l < count; l++) {
+        if ((nbits[l] + (K-1)) & 1) {
+          unsigned char *d = dec + (size_t)(nbits[l] + (K-1) - 1) * NUMSTATES * stride + l / 8;
+          for (int s = 0; s < NUMSTATES; s++)
+            d[s * stride] &= ~(1 << (l % 8));
+        }
+      }
+
+      if (lanes == 64)
+        batch_chainback_lanes((const unsigned long long *)dec, count, nbits, data);
+      else if (lanes == 32)
+        batch_chainback_lanes((const unsigned int *)dec, count, nbits, data);
+      else
+        batch_chainback_lanes((const unsigned short *)dec, count, nbits, data);
+    }
+
+    /*
+     * The batch kernels run one trellis stage at a time over all states, each state's metric
+     * being a vector of one byte per code block. There are only four distinct branch metrics
+     * per stage (one for each combination of expected symbols), those are computed up front.
+     *
+     * Renormalization is per lane, with the same rule as the single block kernels. The amount
+     * to subtract is only known once all new metrics are in, so it is applied when the metrics
+     * are loaded in the next stage instead of with an extra pass.
+     */
+    void viterbi::BATCH_SSE2(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab) {
+        const int L = 16;
+        int pattern[NUMSTATES/2];
+        for (int b = 0; b < NUMSTATES/2; b++)
+            pattern[b] = (Branchtab[b] & 1) | (Branchtab[b + NUMSTATES/2] & 2);
+
+        __m128i *old_m = (__m128i *)metrics;
+        __m128i *new_m = old_m + NUMSTATES;
+        unsigned short *d = (unsigned short *)dec;
+        __m128i renorm = _mm_setzero_si128();
+
+        for (int i = 0; i < nstages; i++) {
+            __m128i s0 = _mm_load_si128((const __m128i *)(syms + (2*i) * L));
+            __m128i s1 = _mm_load_si128((const __m128i *)(syms + (2*i+1) * L));
+            __m128i t[4], nt[4];
+            for (int p = 0; p < 4; p++) {
+                __m128i a = _mm_xor_si128(s0, _mm_set1_epi8((p & 1) ? 0xFF : 0));
+                __m128i b = _mm_xor_si128(s1, _mm_set1_epi8((p & 2) ? 0xFF : 0));
+                t[p] = _mm_and_si128(_mm_srli_epi16(_mm_avg_epu8(a, b), 2), _mm_set1_epi8(63));
+                nt[p] = _mm_subs_epu8(_mm_set1_epi8(63), t[p]);
+            }
+
+            __m128i mn = _mm_set1_epi8((char)255);
+            for (int b = 0; b < NUMSTATES/2; b++) {
+                __m128i lo = _mm_subs_epu8(_mm_load_si128(old_m + b), renorm);
+                __m128i hi = _mm_subs_epu8(_mm_load_si128(old_m + b + NUMSTATES/2), renorm);
+                __m128i tb = t[pattern[b]], ntb = nt[pattern[b]];
+                __m128i m0 = _mm_adds_epu8(lo, tb);
+                __m128i m1 = _mm_adds_epu8(hi, ntb);
+                __m128i m2 = _mm_adds_epu8(lo, ntb);
+                __m128i m3 = _mm_adds_epu8(hi, tb);
+                __m128i even = _mm_min_epu8(m0, m1);
+                __m128i odd = _mm_min_epu8(m2, m3);
+                d[2*b] = _mm_movemask_epi8(_mm_cmpeq_epi8(even, m1));
+                d[2*b+1] = _mm_movemask_epi8(_mm_cmpeq_epi8(odd, m3));
+                _mm_store_si128(new_m + 2*b, even);
+                _mm_store_si128(new_m + 2*b+1, odd);
+                mn = _mm_min_epu8(mn, _mm_min_epu8(even, odd));
+            }
+
+            // Lanes whose new metric 0 is above 210 subtract their minimum
+            __m128i m0 = _mm_load_si128(new_m);
+            __m128i over = _mm_cmpeq_epi8(_mm_max_epu8(m0, _mm_set1_epi8((char)211)), m0);
+            renorm = _mm_and_si128(mn, over);
+
+            std::swap(old_m, new_m);
+            d += NUMSTATES;
+        }
+    }
+
+    /*!
+     * \brief viterbi::BATCH_AVX2
+     *
+     * #BATCH_SSE2 with 32 lanes.
+     */
+    __attribute__((target("avx2")))
+    void viterbi::BATCH_AVX2(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab) {
+        const int L = 32;
+        int pattern[NUMSTATES/2];
+        for (int b = 0; b < NUMSTATES/2; b++)
+            pattern[b] = (Branchtab[b] & 1) | (Branchtab[b + NUMSTATES/2] & 2);
+
+        __m256i *old_m = (__m256i *)metrics;
+        __m256i *new_m = old_m + NUMSTATES;
+        unsigned int *d = (unsigned int *)dec;
+        __m256i renorm = _mm256_setzero_si256();
+
+        for (int i = 0; i < nstages; i++) {
+            __m256i s0 = _mm256_load_si256((const __m256i *)(syms + (2*i) * L));
+            __m256i s1 = _mm256_load_si256((const __m256i *)(syms + (2*i+1) * L));
+            __m256i t[4], nt[4];
+            for (int p = 0; p < 4; p++) {
+                __m256i a = _mm256_xor_si256(s0, _mm256_set1_epi8((p & 1) ? 0xFF : 0));
+                __m256i b = _mm256_xor_si256(s1, _mm256_set1_epi8((p & 2) ? 0xFF : 0));
+                t[p] = _mm256_and_si256(_mm256_srli_epi16(_mm256_avg_epu8(a, b), 2), _mm256_set1_epi8(63));
+                nt[p] = _mm256_subs_epu8(_mm256_set1_epi8(63), t[p]);
+            }
+
+            __m256i mn = _mm256_set1_epi8((char)255);
+            for (int b = 0; b < NUMSTATES/2; b++) {
+                __m256i lo = _mm256_subs_epu8(_mm256_load_si256(old_m + b), renorm);
+                __m256i hi = _mm256_subs_epu8(_mm256_load_si256(old_m + b + NUMSTATES/2), renorm);
+                __m256i tb = t[pattern[b]], ntb = nt[pattern[b]];
+                __m256i m0 = _mm256_adds_epu8(lo, tb);
+                __m256i m1 = _mm256_adds_epu8(hi, ntb);
+                __m256i m2 = _mm256_adds_epu8(lo, ntb);
+                __m256i m3 = _mm256_adds_epu8(hi, tb);
+                __m256i even = _mm256_min_epu8(m0, m1);
+                __m256i odd = _mm256_min_epu8(m2, m3);
+                d[2*b] = _mm256_movemask_epi8(_mm256_cmpeq_epi8(even, m1));
+                d[2*b+1] = _mm256_movemask_epi8(_mm256_cmpeq_epi8(odd, m3));
+                _mm256_store_si256(new_m + 2*b, even);
+                _mm256_store_si256(new_m + 2*b+1, odd);
+                mn = _mm256_min_epu8(mn, _mm256_min_epu8(even, odd));
+            }
+
+            __m256i m0 = _mm256_load_si256(new_m);
+            __m256i over = _mm256_cmpeq_epi8(_mm256_max_epu8(m0, _mm256_set1_epi8((char)211)), m0);
+            renorm = _mm256_and_si256(mn, over);
+
+            std::swap(old_m, new_m);
+            d += NUMSTATES;
+        }
+    }
+
+    /*!
+     * \brief viterbi::BATCH_AVX512
+     *
+     * #BATCH_SSE2 with 64 lanes, the decisions come straight out of the compare masks.
+     */
+    __attribute__((target("avx512f,avx512bw")))
+    void viterbi::BATCH_AVX512(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab) {
+        const int L = 64;
+        int pattern[NUMSTATES/2];
+        for (int b = 0; b < NUMSTATES/2; b++)
+            pattern[b] = (Branchtab[b] & 1) | (Branchtab[b + NUMSTATES/2] & 2);
 
+        __m512i *old_m = (__m512i *)metrics;
+        __m512i *new_m = old_m + NUMSTATES;
+        unsigned long long *d = (unsigned long long *)dec;
+        __m512i renorm = _mm512_setzero_si512();
+
+        for (int i = 0; i < nstages; i++) {
+            __m512i s0 = _mm512_load_si512(syms + (2*i) * L);
+            __m512i s1 = _mm512_load_si512(syms + (2*i+1) * L);
+            __m512i t[4], nt[4];
+            for (int p = 0; p < 4; p++) {
+                __m512i a = _mm512_xor_si512(s0, _mm512_set1_epi8((p & 1) ? 0xFF : 0));
+                __m512i b = _mm512_xor_si512(s1, _mm512_set1_epi8((p & 2) ? 0xFF : 0));
+                t[p] = _mm512_and_si512(_mm512_srli_epi16(_mm512_avg_epu8(a, b), 2), _mm512_set1_epi8(63));
+                nt[p] = _mm512_subs_epu8(_mm512_set1_epi8(63), t[p]);
+            }
+
+            __m512i mn = _mm512_set1_epi8((char)255);
+            for (int b = 0; b < NUMSTATES/2; b++) {
+                __m512i lo = _mm512_subs_epu8(_mm512_load_si512(old_m + b), renorm);
+                __m512i hi = _mm512_subs_epu8(_mm512_load_si512(old_m + b + NUMSTATES/2), renorm);
+                __m512i tb = t[pattern[b]], ntb = nt[pattern[b]];
+                __m512i m0 = _mm512_adds_epu8(lo, tb);
+                __m512i m1 = _mm512_adds_epu8(hi, ntb);
+                __m512i m2 = _mm512_adds_epu8(lo, ntb);
+                __m512i m3 = _mm512_adds_epu8(hi, tb);
+                __m512i even = _mm512_min_epu8(m0, m1);
+                __m512i odd = _mm512_min_epu8(m2, m3);
+                d[2*b] = _mm512_cmple_epu8_mask(m1, m0);
+                d[2*b+1] = _mm512_cmple_epu8_mask(m3, m2);
+                _mm512_store_si512(new_m + 2*b, even);
+                _mm512_store_si512(new_m + 2*b+1, odd);
+                mn = _mm512_min_epu8(mn, _mm512_min_epu8(even, odd));
+            }
+
+            __mmask64 over = _mm512_cmpgt_epu8_mask(_mm512_load_si512(new_m), _mm512_set1_epi8((char)210));
+            renorm = _mm512_maskz_mov_epi8(over, mn);
+
+            std::swap(old_m, new_m);
+            d += NUMSTATES;
+        }
+    }
+}
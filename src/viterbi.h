@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <stdlib.h>
 #include <math.h>
@@ -20,6 +21,8 @@
 #include <xmmintrin.h>
 #include <mmintrin.h>
 
+#include "puncturer.h"
+
 #define K 7
 #define RATE 2
 #define POLYS { 121, 91 }
@@ -35,6 +38,7 @@ namespace fun
     /*! \brief decision_t is a BIT vector */
     typedef union {
         DECISIONTYPE   t[NUMSTATES/DECISIONTYPE_BITSIZE];
+        unsigned long long l[NUMSTATES/64];
         unsigned int   w[NUMSTATES/32];
         unsigned short s[NUMSTATES/16];
         unsigned char  c[NUMSTATES/8];
@@ -72,19 +76,77 @@ namespace fun
               unsigned int nbits, /* Number of data bits */
               unsigned int endstate) ;
 
-        void FULL_SPIRAL(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+        /*!
+         * \brief Signature of the add-compare-select kernels.
+         *
+         * Every kernel processes nbits/2 pairs of trellis stages, swapping between the
+         * metric buffers X and Y, and must produce bit-identical decisions.
+         */
+        typedef void (*acs_kernel)(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+
+        /*! \brief SSE2 add-compare-select kernel (generated by SPIRAL) */
+        static void FULL_SPIRAL(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+
+        /*! \brief Portable add-compare-select kernel, bit-exact with #FULL_SPIRAL */
+        static void FULL_GENERIC(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+
+        /*! \brief AVX2 add-compare-select kernel, all 64 states in two registers, bit-exact with #FULL_SPIRAL */
+        static void FULL_AVX2(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+
+        /*! \brief AVX-512 (VBMI) add-compare-select kernel, falls back to #FULL_AVX2 on CPUs without VBMI */
+        static void FULL_AVX512(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
 
         /*!
-         * \brief Create a new instance of a Viterbi decoder
-         * \param len = FRAMEBITS (unpadded! data bits)
+         * \brief #FULL_SPIRAL on a punctured symbol stream.
+         *
+         * The generated kernel only reads full symbol pairs, so the stream is depunctured for it
+         * in small chunks that stay in L1. P is one of the puncturing patterns in viterbi.cpp.
+         */
+        template<class P>
+        static void FULL_SPIRAL_PUNCTURED(int nbits, unsigned char *Y, unsigned char *X, const unsigned char *syms, unsigned char *dec, unsigned char *Branchtab);
+
+        /*!
+         * \brief Signature of the batch add-compare-select kernels.
+         *
+         * A batch kernel runs the trellises of several code blocks side by side, one block per
+         * byte lane. The symbols are interleaved as [stage][2][lane], the metrics as
+         * [2][state][lane] and the decisions are stored as one lane mask per stage and state.
          */
-        struct v *viterbi_alloc(int len);
+        typedef void (*batch_kernel)(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab);
+
+        /*! \brief SSE2 batch kernel, 16 code blocks */
+        static void BATCH_SSE2(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab);
+
+        /*! \brief AVX2 batch kernel, 32 code blocks */
+        static void BATCH_AVX2(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab);
+
+        /*! \brief AVX-512 batch kernel, 64 code blocks */
+        static void BATCH_AVX512(int nstages, const unsigned char *syms, unsigned char *metrics, unsigned char *dec, const unsigned char *Branchtab);
+
+        /*!
+         * \brief Traces back the lanes of a batch decode.
+         * \param dec Decisions written by the batch kernel.
+         * \param lanes Number of lanes of the kernel.
+         * \param count Number of lanes in use.
+         * \param nbits Number of data bits of the block in each lane, in decreasing order.
+         * \param data Output data of each lane.
+         */
+        static void batch_chainback(unsigned char *dec, int lanes, int count, const int *nbits, unsigned char * const *data);
+
+        struct v * m_vp;   //!< Decoder state, allocated on the first decode and reused afterwards
+        int m_max_bits;    //!< Number of data bits the decision memory in #m_vp can currently hold
+
+        unsigned char * m_batch_mem; //!< Symbols, metrics and decisions of #conv_decode_batch
+        size_t m_batch_size;         //!< Size of #m_batch_mem in bytes
 
         /*!
-         * \brief Destroy instance of a Viterbi decoder
-         * \param vp pointer to the v struct to free
+         * \brief Makes sure the decoder state can hold a frame of len data bits.
+         * \param len = FRAMEBITS (unpadded! data bits)
+         * \return pointer to the v struct or NULL if the allocation failed
+         *
+         * The decision memory only grows, so steady state decoding doesn't allocate.
          */
-        void viterbi_free(struct v *vp);
+        struct v *viterbi_reserve(int len);
 
         /*!
          * \brief Initialize decoder for start of new frame
@@ -99,17 +161,84 @@ namespace fun
          * \param symbols Input symbol to be decoded
          * \param data Output data that has been decoded
          *
+         * \param pattern Puncturing pattern of the symbols.
+         *
          * NOTE: nbits has to match what was passed to viterbi_alloc(...)
          * FIXME: store nbits in struct v?
          */
-        void viterbi_decode(struct v *vp, const COMPUTETYPE *symbols, unsigned char *data, int nbits);
+        void viterbi_decode(struct v *vp, const COMPUTETYPE *symbols, unsigned char *data, int nbits, puncturing pattern = PUNCTURE_NONE);
+
+        /*!
+         * \brief Runs the add-compare-select kernel selected by cpu_features over the block.
+         */
+        void viterbi_update_blk(struct v *vp, const COMPUTETYPE *syms, int nbits, puncturing pattern = PUNCTURE_NONE);
+
+        /*!
+         * \brief Gets the add-compare-select kernel for the active cpu_features level.
+         * \param pattern Puncturing pattern of the symbols the kernel reads.
+         */
+        static acs_kernel acs(puncturing pattern = PUNCTURE_NONE);
+
+        struct segment_worker;
+
+        std::vector<std::unique_ptr<segment_worker>> m_segment_workers; //!< Threads that decode the segments of #conv_decode_parallel, started on first use
+
+        /*!
+         * \brief Decodes the data bits [start, end) of a code block on its own.
+         * \param symbols Coded symbols of the whole block.
+         * \param data Output data of the whole block, only the bytes of the segment are written.
+         * \param data_bits Number of data bits of the whole block.
+         * \param start First data bit of the segment, a multiple of 8.
+         * \param end End of the segment, a multiple of 8 or data_bits.
+         *
+         * The trellis is started a warm-up margin before the segment from equal metrics (or
+         * from state 0 at the start of the block) and traced back from the best state a
+         * traceback margin after the segment (or from state 0 at the end of the block).
+         */
+        void segment_decode(const unsigned char *symbols, unsigned char *data, int data_bits, int start, int end);
+
+        int m_tb_depth;                //!< Traceback depth of the stream in stages
+        int m_stream_cap;              //!< Number of stages the circular decision buffer holds
+        long long m_stages;            //!< Number of stages of the stream processed so far
+        long long m_emitted;           //!< Number of decoded bits of the stream handed out so far
+        COMPUTETYPE m_pending[2*RATE]; //!< Symbols that don't make up a full pair of stages yet
+        int m_npending;                //!< Number of symbols in #m_pending
 
-        /*! \brief set the viterbi decoder to use a specific implementation */
-        void viterbi_update_blk_SPIRAL(struct v *vp, const COMPUTETYPE *syms, int nbits);
+        /*!
+         * \brief Runs the kernel over pairs of stages of the stream and hands out the decoded
+         *        bytes that are at least #m_tb_depth stages old.
+         * \param syms Symbols, a multiple of 2*RATE.
+         * \param count Number of symbols.
+         * \param data Output for the decoded bytes.
+         * \return Number of bytes written to data.
+         */
+        int stream_update(const COMPUTETYPE *syms, int count, unsigned char *data);
+
+        /*!
+         * \brief Traces back through the circular decision buffer.
+         * \param endstate State to start from at the last processed stage.
+         * \param end_bit Decoded bits from #m_emitted up to (excluding) end_bit are written.
+         * \param data Output for the decoded bytes.
+         * \return Number of bytes written to data.
+         */
+        int stream_traceback(unsigned int endstate, long long end_bit, unsigned char *data);
         //void viterbi_spiral(struct v *vp);
 
     public:
 
+        /*!
+         * \brief Constructor for the viterbi class.
+         *
+         * Builds the branch table. The decision memory is only allocated once decoding is
+         * needed, so encode-only instances stay cheap.
+         */
+        viterbi();
+
+        /*!
+         * \brief Destructor, frees the decoder state.
+         */
+        ~viterbi();
+
         /*!
          * \brief Decodes convolutionally encoded data using the viterbi algorithm.
          * \param symbols Coded symbols that need to be decoded.
@@ -118,6 +247,88 @@ namespace fun
          */
         void conv_decode(unsigned char * symbols, unsigned char * data, int data_bits);
 
+        /*!
+         * \brief Decodes punctured convolutionally encoded data without depuncturing it first.
+         * \param symbols Punctured coded symbols, as produced by puncturer::puncture.
+         * \param data Output data that has been decoded.
+         * \param data_bits Number of data bits that that should be left after decoding.
+         * \param pattern The puncturing pattern of the symbols.
+         *
+         * The output is identical to depuncturing with puncturer::depuncture and calling
+         * conv_decode on the result.
+         */
+        void conv_decode(const unsigned char * symbols, unsigned char * data, int data_bits, puncturing pattern);
+
+        /*!
+         * \brief Decodes several independent code blocks at once.
+         * \param symbols Coded symbols of each block.
+         * \param data Output buffers for the decoded data of each block.
+         * \param data_bits Number of data bits of each block.
+         * \param count Number of blocks.
+         *
+         * Every block gets its own byte lane in the SIMD registers, so a batch of short frames
+         * keeps the vector units as busy as one long frame. Blocks of similar length are grouped
+         * and each group is padded to its longest block. The output is identical to calling
+         * #conv_decode for each block.
+         */
+        void conv_decode_batch(unsigned char * const * symbols, unsigned char * const * data, const int * data_bits, int count);
+
+        /*!
+         * \brief Decodes a long code block on several threads.
+         * \param symbols Coded symbols that need to be decoded.
+         * \param data Output data that has been decoded.
+         * \param data_bits Number of data bits that that should be left after decoding.
+         * \param threads Maximum number of threads to use, 0 for one per hardware thread.
+         *
+         * The block is split into segments that are decoded independently, each with a
+         * warm-up and a traceback margin of overlap with its neighbours. The output is the
+         * same as #conv_decode unless the survivor paths haven't merged within the margins,
+         * which doesn't happen at usable SNRs. Blocks too short to be worth splitting are
+         * decoded by #conv_decode on the calling thread.
+         */
+        void conv_decode_parallel(unsigned char * symbols, unsigned char * data, int data_bits, int threads = 0);
+
+        /*!
+         * \brief Gets the number of segments #conv_decode_parallel splits a block into.
+         * \param data_bits Number of data bits of the block.
+         * \param threads Maximum number of threads to use, 0 for one per hardware thread.
+         * \return 1 if the block is decoded on the calling thread alone.
+         */
+        static int parallel_segments(int data_bits, int threads = 0);
+
+        /*!
+         * \brief Starts decoding a new stream of symbols.
+         * \param traceback_depth Number of stages a decoded bit is held back before it is
+         *        handed out, 5 to 10 times the constraint length is usually enough.
+         * \return false if the decision memory couldn't be allocated.
+         *
+         * The stream decoder only keeps the decisions of the last traceback_depth (plus a
+         * small constant) stages, so its memory doesn't depend on the frame length. While a
+         * stream is open the object must not be used for #conv_decode.
+         */
+        bool stream_begin(int traceback_depth = 10 * K);
+
+        /*!
+         * \brief Feeds symbols of the current stream to the decoder.
+         * \param symbols The next coded symbols, any number of them.
+         * \param count Number of symbols.
+         * \param data Output for the decoded bytes that became final, needs room for
+         *        count/16 + 16 bytes.
+         * \return Number of bytes written to data.
+         */
+        int stream_decode(const unsigned char * symbols, int count, unsigned char * data);
+
+        /*!
+         * \brief Ends the current stream, which must have been terminated with the K-1 tail
+         *        bits of #conv_encode, and hands out the remaining decoded bytes.
+         * \param data Output for the decoded bytes, needs room for traceback_depth/8 + 16 bytes.
+         * \return Number of bytes written to data.
+         *
+         * If the whole stream fits into the traceback depth, the output is identical to
+         * #conv_decode on the whole stream.
+         */
+        int stream_end(unsigned char * data);
+
         /*!
          * \brief Convolutionally encodeds data.
          * \param data The data to be coded.
@@ -125,6 +336,25 @@ namespace fun
          * \param data_bits The number of bits in the data input.
          */
         void conv_encode(unsigned char * data, unsigned char * symbols, int data_bits);
+
+        /*!
+         * \brief Convolutionally encodes data a byte at a time and punctures it on the fly.
+         * \param data The data to be coded, MSB first, followed by the K-1 tail bits.
+         * \param symbols The coded output symbols, one byte (0 or 1) per symbol or packed
+         *        MSB first (the last byte is zero padded).
+         * \param data_bits The number of bits in the data input.
+         * \param pattern The puncturing pattern applied to the coded symbols.
+         * \param packed Whether to pack 8 symbols into each output byte.
+         * \return The number of coded symbols written.
+         *
+         * The unpacked output is identical to #conv_encode followed by puncturer::puncture.
+         */
+        static int conv_encode(const unsigned char * data, unsigned char * symbols, int data_bits, puncturing pattern, bool packed = false);
+
+    private:
+
+        viterbi(const viterbi &) = delete;             //!< The decoder state is not shareable
+        viterbi & operator=(const viterbi &) = delete; //!< The decoder state is not shareable
     };
 
 }